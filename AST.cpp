@@ -1,84 +1,25 @@
+#include "AllocStats.hpp"
 #include "AST.hpp"
-
-const QSet <QString> Environment {
-	Strings::Document,
-	Strings::Enumerate,
-	Strings::Itemize,
-	Strings::Verbatim,
-	"center",
-};
-
-const QSet <QString> Fragment {
-	Strings::BoldFace,
-	Strings::Hspace,
-	Strings::Input,
-	Strings::Italic,
-	Strings::Section,
-	Strings::SourceCode,
-	Strings::Subsection,
-	Strings::TextTT,
-	Strings::Title,
-	"hspace*",
-	"mbox",
-	"textsf",
-
-	Highlight::CommentBlock,
-	Highlight::CommentCpp,
-	Highlight::Escape,
-	Highlight::KeywordA,
-	Highlight::KeywordB,
-	Highlight::KeywordC,
-	Highlight::IncludeQuote,
-	Highlight::LineNumbering,
-	Highlight::NumberConstant,
-	Highlight::Operator,
-	Highlight::Preprocessor,
-	Highlight::Standard,
-	Highlight::String,
-	Highlight::StringSubstitution,
-	Highlight::Type,
-};
-
-const QSet <QString> Tag {
-	Strings::Backslash,
-	Strings::CodeTilde,
-	Strings::Item,
-	Strings::Ldots,
-	Strings::MakeTitle,
-	Strings::NormalFont,
-	Strings::Quote,
-	Strings::Textbar,
-	Strings::TextBackslash,
-	Strings::Tilde,
-	Strings::TTFamily,
-	Strings::Underscore,
-	"fill",
-	"indent",
-	"noindent",
-	"normalsize",
-};
+#include "Budget.hpp"
+#include "Diagnostics.hpp"
+#include "Keywords.hpp"
 
 static inline constexpr uint qHash(const Node::Type &t)
 {
 	return ::qHash(static_cast<typename std::underlying_type<std::decay_t<decltype(t)> >::type>(t));
 }
 
-Node::Type Node::typeFromName(const QString &name)
+Node::Type Node::typeFromName(const QByteArray &name)
 {
-	using TypePair = QPair <const QSet <QString> *, Node::Type>;
-	static const Vector <TypePair> TypeVector {
-		{&Environment, Type::Environment},
-		{&Fragment, Type::Fragment},
-		{&Tag, Type::Tag},
-	};
-
-	for (auto p : TypeVector) {
-		if (p.first->contains(name))
-			return p.second;
-	}
+	const quint8 flags = Keywords::find(name).flags;
+	if (flags & Keywords::Environment)
+		return Type::Environment;
+	if (flags & Keywords::Fragment)
+		return Type::Fragment;
+	if (flags & Keywords::Tag)
+		return Type::Tag;
 
-	qCritical() << QString{"Unknown type for '%1'"}.arg(name);
-	std::exit(1);
+	Diagnostics::error(QString{"Unknown type for '%1'"}.arg(name));
 	return Type::Invalid;
 }
 
@@ -92,17 +33,43 @@ QString Node::toString() const
 	};
 
 	QString typeString = TypeHash.value(type, "Invalid");
-	return QString{"type = %1, value = _%2_, endParagraph = %3"}.arg(typeString).arg(value).arg(endParagraph);
+	return QString{"type = %1, value = _%2_, endParagraph = %3"}.arg(typeString).arg(QString::fromUtf8(value)).arg(endParagraph);
 }
 
-Node & Node::appendNode(Node::Type type, const QString &value)
+Node Node::clone() const
 {
-	QString temp{value};
+	Budget::addNodes(1);
+	Node result{type, QByteArray{value}};
+	result.endParagraph = endParagraph;
+	result.children.reserve(children.count());
+	for (const Node &child : children)
+		result.children.push_back(child.clone());
+	return result;
+}
+
+Node & Node::appendNode(Node::Type type, const QByteArray &value)
+{
+	ALLOC_SITE("Node::appendNode(const QByteArray &)");
+	QByteArray temp{value};
 	return appendNode(type, std::move(temp));
 }
 
-Node & Node::appendNode(Node::Type type, QString &&value)
+Node & Node::appendNode(Node::Type type, QByteArray &&value)
 {
+	ALLOC_SITE("Node::appendNode");
+	Budget::addNodes(1);
 	children.push_back(Node{type, std::move(value)});
 	return children.back();
 }
+
+bool Node::operator == (const Node &other) const
+{
+	if (type != other.type || endParagraph != other.endParagraph || value != other.value || children.count() != other.children.count())
+		return false;
+
+	for (int i = 0; i < children.count(); ++i) {
+		if (!(children[i] == other.children[i]))
+			return false;
+	}
+	return true;
+}
@@ -6,10 +6,6 @@
 #include "Strings.hpp"
 #include "Vector.hpp"
 
-extern const QSet <QString> Environment;
-extern const QSet <QString> Fragment;
-extern const QSet <QString> Tag;
-
 struct Node {
 	enum class Type : quint8 {
 		Invalid,
@@ -20,18 +16,20 @@ struct Node {
 	};
 
 	Node() = default;
-	Node(Type type, QString &&value) : type{type}, value{std::move(value)} {}
+	Node(Type type, QByteArray &&value) : type{type}, value{std::move(value)} {}
 	Node(Node &&) = default;
 	Node & operator = (Node &&) = default;
 
-	static Type typeFromName(const QString &name);
+	static Type typeFromName(const QByteArray &name);
 	QString toString() const;
+	Node clone() const;
+	bool operator == (const Node &other) const;
 
-	Node & appendNode(Node::Type type, const QString &value);
-	Node & appendNode(Node::Type type, QString &&value);
+	Node & appendNode(Node::Type type, const QByteArray &value);
+	Node & appendNode(Node::Type type, QByteArray &&value);
 
-	Type type;
-	QString value;
+	Type type = Type::Invalid;
+	QByteArray value; // UTF-8
 	bool endParagraph = false;
 	Vector <Node> children;
 };
@@ -0,0 +1,125 @@
+#ifdef ODTGEN_ALLOC_STATS
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+#include "AllocStats.hpp"
+#include "Stats.hpp"
+
+extern "C" {
+
+void * __libc_malloc(size_t size);
+void * __libc_calloc(size_t count, size_t size);
+void * __libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+
+}
+
+namespace {
+
+constexpr int MaxTags = 64;
+
+struct Counter {
+	std::atomic <quint64> count{0};
+	std::atomic <quint64> bytes{0};
+};
+
+// slot 0 collects everything allocated outside of any tagged scope
+const char *tags[MaxTags] = {"untagged"};
+std::atomic <int> tagCount{1};
+std::mutex tagMutex;
+
+Counter phases[MaxTags];
+Counter sites[MaxTags];
+
+thread_local int currentPhase __attribute__((tls_model("initial-exec"))) = 0;
+thread_local int currentSite __attribute__((tls_model("initial-exec"))) = 0;
+
+inline void record(size_t size)
+{
+	phases[currentPhase].count.fetch_add(1, std::memory_order_relaxed);
+	phases[currentPhase].bytes.fetch_add(size, std::memory_order_relaxed);
+	sites[currentSite].count.fetch_add(1, std::memory_order_relaxed);
+	sites[currentSite].bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+}
+
+extern "C" {
+
+void * malloc(size_t size)
+{
+	record(size);
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+	record(count * size);
+	return __libc_calloc(count, size);
+}
+
+void * realloc(void *ptr, size_t size)
+{
+	record(size);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+}
+
+namespace AllocStats {
+
+int tagIndex(const char *tag)
+{
+	std::lock_guard <std::mutex> lock{tagMutex};
+	const int count = tagCount.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; ++i) {
+		if (tags[i] == tag || strcmp(tags[i], tag) == 0)
+			return i;
+	}
+
+	if (count == MaxTags)
+		return 0;
+
+	tags[count] = tag;
+	tagCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+Scope::Scope(Kind kind, int tag) : m_kind{kind}
+{
+	int &current = (kind == Kind::Phase) ? currentPhase : currentSite;
+	m_previous = current;
+	current = tag;
+}
+
+Scope::~Scope()
+{
+	int &current = (m_kind == Kind::Phase) ? currentPhase : currentSite;
+	current = m_previous;
+}
+
+void report()
+{
+	const int count = tagCount.load(std::memory_order_acquire);
+	for (int i = 0; i < count; ++i) {
+		if (phases[i].count != 0) {
+			Stats::set(QString{"alloc.phase.%1.count"}.arg(tags[i]), phases[i].count);
+			Stats::set(QString{"alloc.phase.%1.bytes"}.arg(tags[i]), phases[i].bytes);
+		}
+		if (sites[i].count != 0) {
+			Stats::set(QString{"alloc.site.%1.count"}.arg(tags[i]), sites[i].count);
+			Stats::set(QString{"alloc.site.%1.bytes"}.arg(tags[i]), sites[i].bytes);
+		}
+	}
+}
+
+} // AllocStats
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * Heap allocation accounting, compiled in with `make ALLOC_STATS=1`.
+ * Every malloc/calloc/realloc (and thus every operator new and Qt container
+ * allocation) is counted against the innermost phase and call-site tag of
+ * the allocating thread. report() publishes the totals through Stats.
+ * The hooks are linked into the odtgen binary only; a library built this
+ * way leaves AllocStats to the program using it.
+ */
+#ifdef ODTGEN_ALLOC_STATS
+
+namespace AllocStats {
+
+class Scope {
+public:
+	enum class Kind {
+		Phase,
+		Site,
+	};
+
+	Scope(Kind kind, int tag);
+	~Scope();
+
+private:
+	Kind m_kind;
+	int m_previous;
+};
+
+int tagIndex(const char *tag);
+void report();
+
+} // AllocStats
+
+#define ALLOC_CONCAT_IMPL(a, b) a ## b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_IMPL(a, b)
+#define ALLOC_SCOPE(kind, tag) \
+	static const int ALLOC_CONCAT(allocTag##kind, __LINE__) = AllocStats::tagIndex(tag); \
+	AllocStats::Scope ALLOC_CONCAT(allocScope##kind, __LINE__){AllocStats::Scope::Kind::kind, ALLOC_CONCAT(allocTag##kind, __LINE__)}
+#define ALLOC_PHASE(tag) ALLOC_SCOPE(Phase, tag)
+#define ALLOC_SITE(tag) ALLOC_SCOPE(Site, tag)
+
+#else
+
+namespace AllocStats {
+
+inline void report() {}
+
+} // AllocStats
+
+#define ALLOC_PHASE(tag)
+#define ALLOC_SITE(tag)
+
+#endif
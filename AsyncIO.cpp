@@ -0,0 +1,432 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "AsyncIO.hpp"
+
+namespace {
+
+std::atomic <bool> enabled{true};
+
+using Result = std::optional <QByteArray>;
+
+struct Batch {
+	void settle(int idx, Result result)
+	{
+		results[idx].set_value(std::move(result));
+		settled[idx] = true;
+	}
+
+	QVector <QByteArray> paths;
+	std::vector <std::promise <Result> > results;
+	std::vector <bool> settled;
+};
+
+/*
+ * The fallback: one file after the other, with plain open, fstat and pread.
+ */
+void readPlain(Batch &batch)
+{
+	for (int i = 0; i < batch.paths.count(); ++i) {
+		if (batch.settled[i])
+			continue;
+
+		const int fd = ::open(batch.paths[i].constData(), O_RDONLY | O_CLOEXEC);
+		struct stat info;
+		if (fd == -1 || ::fstat(fd, &info) == -1) {
+			if (fd != -1)
+				::close(fd);
+			batch.settle(i, Result{});
+			continue;
+		}
+
+		QByteArray data{static_cast<int>(info.st_size), Qt::Uninitialized};
+		qint64 done = 0;
+		bool failed = false;
+		while (done < data.size()) {
+			const ssize_t count = ::pread(fd, data.data() + done, data.size() - done, done);
+			if (count == -1 && errno == EINTR)
+				continue;
+			failed = (count == -1);
+			if (count <= 0)
+				break;
+			done += count;
+		}
+		::close(fd);
+
+		data.resize(done);
+		batch.settle(i, failed ? Result{} : Result{std::move(data)});
+	}
+}
+
+#ifdef ODTGEN_HAVE_IO_URING
+
+/*
+ * Keeps up to a ring's worth of files in flight: an open is queued for each
+ * file, and the read of a file is queued when its open completes. The user
+ * data of a request is the file index, shifted left by one, with the low
+ * bit set for reads. A file whose request the kernel turns down as
+ * unsupported is left unsettled, as are all files when the ring fails.
+ */
+void readRing(Batch &batch)
+{
+	struct File {
+		int fd = -1;
+		QByteArray data;
+		qint64 done = 0;
+		bool busy = false; // a request of the file is in the ring
+	};
+	const int count = batch.paths.count();
+	std::vector <File> files(count);
+
+	// torn down before the buffers it may still be reading into
+	IoUring ring{64};
+	if (!ring.valid() || !ring.supports(IORING_OP_OPENAT) || !ring.supports(IORING_OP_READ))
+		return;
+	int next = 0, finished = 0, inFlight = 0;
+
+	auto finish = [&](int idx, bool ok) {
+		File &file = files[idx];
+		if (file.fd != -1)
+			::close(file.fd);
+		file.fd = -1;
+		file.data.resize(file.done);
+		batch.settle(idx, ok ? Result{std::move(file.data)} : Result{});
+		++finished;
+		--inFlight;
+	};
+
+	auto leave = [&](int idx) {
+		File &file = files[idx];
+		if (file.fd != -1)
+			::close(file.fd);
+		file.fd = -1;
+		++finished;
+		--inFlight;
+	};
+
+	/*
+	 * The kernel may still be opening files and reading into the buffers,
+	 * so the requests left are cancelled and reaped before the buffers go.
+	 * Should the ring fail at that too, the buffers are leaked instead.
+	 */
+	auto abandon = [&files, &ring]() {
+		const quint64 Cancel = ~quint64(0);
+		int outstanding = 0;
+		for (int i = 0; i < static_cast<int>(files.size()); ++i) {
+			if (!files[i].busy)
+				continue;
+			++outstanding;
+
+			const quint64 userData = (quint64(i) << 1) | (files[i].fd != -1);
+			if (ring.supports(IORING_OP_ASYNC_CANCEL)
+					&& (ring.prepareCancel(userData, Cancel) || (ring.submit() && ring.prepareCancel(userData, Cancel))))
+				++outstanding;
+		}
+
+		for (; outstanding != 0; --outstanding) {
+			quint64 userData;
+			int result;
+			if (!ring.wait(userData, result)) {
+				for (File &file : files) {
+					if (file.busy)
+						new QByteArray{std::move(file.data)};
+				}
+				break;
+			}
+			if (userData != Cancel && (userData & 1) == 0 && result >= 0)
+				::close(result);
+		}
+
+		for (File &file : files) {
+			if (file.fd != -1)
+				::close(file.fd);
+		}
+	};
+
+	while (finished != count) {
+		while (next != count && inFlight < static_cast<int>(ring.entries())) {
+			if (!ring.prepareOpen(batch.paths[next].constData(), O_RDONLY | O_CLOEXEC, quint64(next) << 1))
+				break;
+			files[next].busy = true;
+			++next;
+			++inFlight;
+		}
+
+		quint64 userData;
+		int result;
+		if (!ring.wait(userData, result))
+			return abandon();
+
+		const int idx = userData >> 1;
+		File &file = files[idx];
+		file.busy = false;
+		if (result == -EINVAL || result == -EOPNOTSUPP) {
+			leave(idx);
+			continue;
+		}
+		if (result < 0) {
+			finish(idx, false);
+			continue;
+		}
+
+		if ((userData & 1) == 0) {
+			file.fd = result;
+			struct stat info;
+			if (::fstat(file.fd, &info) == -1) {
+				finish(idx, false);
+				continue;
+			}
+			file.data = QByteArray{static_cast<int>(info.st_size), Qt::Uninitialized};
+		} else {
+			file.done += result;
+			if (result == 0)
+				file.data.resize(file.done); // the file shrank meanwhile
+		}
+
+		if (file.done == file.data.size()) {
+			finish(idx, true);
+		} else if (ring.prepareRead(file.fd, file.data.data() + file.done, file.data.size() - file.done,
+				file.done, (quint64(idx) << 1) | 1)) {
+			file.busy = true;
+		} else {
+			return abandon();
+		}
+	}
+}
+
+#endif
+
+}
+
+IoUring::IoUring(unsigned entries)
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	if (!enabled)
+		return;
+
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	const int fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0)
+		return;
+
+	m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMap)
+		m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+
+	m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	m_cqRing = singleMap ? m_sqRing : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+	m_sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED) {
+		if (m_sqRing != MAP_FAILED)
+			munmap(m_sqRing, m_sqRingSize);
+		if (!singleMap && m_cqRing != MAP_FAILED)
+			munmap(m_cqRing, m_cqRingSize);
+		if (m_sqes != MAP_FAILED)
+			munmap(m_sqes, m_sqesSize);
+		m_sqRing = m_cqRing = m_sqes = nullptr;
+		::close(fd);
+		return;
+	}
+
+	char *sq = static_cast<char *>(m_sqRing);
+	m_sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+	m_sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+	m_sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+	m_sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+	char *cq = static_cast<char *>(m_cqRing);
+	m_cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+	m_cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+	m_cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+	m_cqes = cq + params.cq_off.cqes;
+
+	m_fd = fd;
+	m_entries = params.sq_entries;
+	m_features = params.features;
+
+#ifdef IO_URING_OP_SUPPORTED
+	// fails before 5.6, which leaves every operation unsupported
+	std::vector <char> buffer(sizeof(io_uring_probe) + m_supported.size() * sizeof(io_uring_probe_op));
+	io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+	if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, m_supported.size()) == 0) {
+		for (int i = 0; i < probe->ops_len; ++i) {
+			if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+				m_supported.set(probe->ops[i].op);
+		}
+	}
+#endif
+#else
+	Q_UNUSED(entries);
+#endif
+}
+
+IoUring::~IoUring()
+{
+	if (m_fd == -1)
+		return;
+
+	munmap(m_sqes, m_sqesSize);
+	if (m_cqRing != m_sqRing)
+		munmap(m_cqRing, m_cqRingSize);
+	munmap(m_sqRing, m_sqRingSize);
+	::close(m_fd);
+}
+
+void IoUring::setEnabled(bool enable)
+{
+	enabled = enable;
+}
+
+bool IoUring::currentPosition() const
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	return m_features & IORING_FEAT_RW_CUR_POS;
+#else
+	return false;
+#endif
+}
+
+bool IoUring::prepareOpen(const char *path, int flags, quint64 userData)
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	return prepare(IORING_OP_OPENAT, AT_FDCWD, path, 0, 0, userData, flags);
+#else
+	Q_UNUSED(path); Q_UNUSED(flags); Q_UNUSED(userData);
+	return false;
+#endif
+}
+
+bool IoUring::prepareRead(int fd, void *buffer, quint32 size, quint64 offset, quint64 userData)
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	return prepare(IORING_OP_READ, fd, buffer, size, offset, userData);
+#else
+	Q_UNUSED(fd); Q_UNUSED(buffer); Q_UNUSED(size); Q_UNUSED(offset); Q_UNUSED(userData);
+	return false;
+#endif
+}
+
+bool IoUring::prepareWrite(int fd, const void *data, quint32 size, quint64 offset, quint64 userData)
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	return prepare(IORING_OP_WRITE, fd, data, size, offset, userData);
+#else
+	Q_UNUSED(fd); Q_UNUSED(data); Q_UNUSED(size); Q_UNUSED(offset); Q_UNUSED(userData);
+	return false;
+#endif
+}
+
+bool IoUring::prepareCancel(quint64 target, quint64 userData)
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	return prepare(IORING_OP_ASYNC_CANCEL, -1, reinterpret_cast<const void *>(target), 0, 0, userData);
+#else
+	Q_UNUSED(target); Q_UNUSED(userData);
+	return false;
+#endif
+}
+
+bool IoUring::prepare(quint8 opcode, int fd, const void *addr, quint32 len, quint64 offset, quint64 userData, quint32 flags)
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	const unsigned tail = *m_sqTail;
+	if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) == m_entries)
+		return false;
+
+	const unsigned idx = tail & *m_sqMask;
+	io_uring_sqe *sqe = static_cast<io_uring_sqe *>(m_sqes) + idx;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<quint64>(addr);
+	sqe->len = len;
+	sqe->off = offset;
+	sqe->open_flags = flags;
+	sqe->user_data = userData;
+	m_sqArray[idx] = idx;
+
+	__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+	++m_queued;
+	return true;
+#else
+	Q_UNUSED(opcode); Q_UNUSED(fd); Q_UNUSED(addr); Q_UNUSED(len); Q_UNUSED(offset); Q_UNUSED(userData); Q_UNUSED(flags);
+	return false;
+#endif
+}
+
+bool IoUring::submit()
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	while (m_queued != 0) {
+		const int submitted = syscall(__NR_io_uring_enter, m_fd, m_queued, 0, 0, nullptr, 0);
+		if (submitted < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return false;
+		}
+		m_queued -= submitted;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool IoUring::wait(quint64 &userData, int &result)
+{
+#ifdef ODTGEN_HAVE_IO_URING
+	for (;;) {
+		const unsigned head = *m_cqHead;
+		if (head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+			const io_uring_cqe *cqe = static_cast<const io_uring_cqe *>(m_cqes) + (head & *m_cqMask);
+			userData = cqe->user_data;
+			result = cqe->res;
+			__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+
+		const int submitted = syscall(__NR_io_uring_enter, m_fd, m_queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		if (submitted < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return false;
+		}
+		m_queued -= submitted;
+	}
+#else
+	Q_UNUSED(userData); Q_UNUSED(result);
+	return false;
+#endif
+}
+
+ReadBatch readFiles(const QStringList &paths)
+{
+	auto batch = std::make_shared<Batch>();
+	batch->results.resize(paths.count());
+	batch->settled.resize(paths.count(), false);
+	for (const QString &path : paths)
+		batch->paths.append(QFile::encodeName(path));
+
+	ReadBatch result;
+	for (std::promise <Result> &file : batch->results)
+		result.files.push_back(file.get_future());
+
+	result.done = std::async(std::launch::async, [batch](){
+#ifdef ODTGEN_HAVE_IO_URING
+		readRing(*batch);
+#endif
+		// whatever the ring left, for lack of a ring, of an operation or of success, is read the plain way
+		readPlain(*batch);
+	});
+	return result;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <bitset>
+#include <future>
+#include <optional>
+#include <vector>
+#include <QtCore>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ODTGEN_HAVE_IO_URING
+#endif
+
+/*
+ * Minimal io_uring on the raw system calls: one submission and one
+ * completion ring, driven by a single thread. valid() is false where the
+ * kernel, or a seccomp filter, refuses io_uring, and after
+ * setEnabled(false); callers then take their plain system-call path. So do
+ * they for an operation that supports() denies: kernels before 5.6 set up a
+ * ring but know neither the probe nor openat and read on it.
+ */
+class IoUring {
+public:
+	explicit IoUring(unsigned entries);
+	~IoUring();
+
+	IoUring(const IoUring &) = delete;
+	IoUring & operator = (const IoUring &) = delete;
+
+	static void setEnabled(bool enabled);
+
+	bool valid() const { return m_fd != -1; }
+	bool supports(quint8 opcode) const { return m_supported[opcode]; }
+	bool currentPosition() const; // offset -1 reads and writes at the file position
+	unsigned entries() const { return m_entries; }
+
+	/*
+	 * These queue a request without submitting it and fail when the ring is
+	 * full. An offset of -1 means the file position.
+	 */
+	bool prepareOpen(const char *path, int flags, quint64 userData);
+	bool prepareRead(int fd, void *buffer, quint32 size, quint64 offset, quint64 userData);
+	bool prepareWrite(int fd, const void *data, quint32 size, quint64 offset, quint64 userData);
+	/* Cancels the request with user data `target`; both complete. */
+	bool prepareCancel(quint64 target, quint64 userData);
+	bool submit();
+	/* Submits what is queued and waits for one completion. */
+	bool wait(quint64 &userData, int &result);
+
+private:
+	bool prepare(quint8 opcode, int fd, const void *addr, quint32 len, quint64 offset, quint64 userData, quint32 flags = 0);
+
+	int m_fd = -1;
+	unsigned m_entries = 0;
+	unsigned m_queued = 0;
+	quint32 m_features = 0;
+	std::bitset <256> m_supported;
+
+	void *m_sqRing = nullptr;
+	size_t m_sqRingSize = 0;
+	void *m_cqRing = nullptr;
+	size_t m_cqRingSize = 0;
+	void *m_sqes = nullptr;
+	size_t m_sqesSize = 0;
+
+	unsigned *m_sqHead = nullptr;
+	unsigned *m_sqTail = nullptr;
+	unsigned *m_sqMask = nullptr;
+	unsigned *m_sqArray = nullptr;
+	unsigned *m_cqHead = nullptr;
+	unsigned *m_cqTail = nullptr;
+	unsigned *m_cqMask = nullptr;
+	void *m_cqes = nullptr;
+};
+
+/*
+ * Reading a set of files with many requests in flight. The reads run on a
+ * worker thread, so they overlap with whatever the caller does, and each
+ * result becomes ready as soon as its own file has been read.
+ */
+struct ReadBatch {
+	std::vector <std::future <std::optional <QByteArray> > > files; // in the order of the paths
+	std::future <void> done; // the worker; waits in its destructor
+};
+
+ReadBatch readFiles(const QStringList &paths);
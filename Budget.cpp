@@ -0,0 +1,123 @@
+#include "Budget.hpp"
+#include "Diagnostics.hpp"
+
+namespace {
+
+thread_local Budget *currentBudget = nullptr;
+thread_local int nesting = 0;
+
+}
+
+Budget::Budget(const Limits &limits) : m_limits{limits}
+{
+	m_timer.start();
+}
+
+bool Budget::addNodes(qint64 count)
+{
+	Budget *budget = currentBudget;
+	if (budget == nullptr)
+		return true;
+
+	const qint64 nodes = budget->m_nodes += count;
+	if (budget->m_limits.nodes > 0 && nodes > budget->m_limits.nodes)
+		return budget->fail(QString{"document exceeds the limit of %1 nodes"}.arg(budget->m_limits.nodes));
+	return !budget->m_exceeded;
+}
+
+bool Budget::checkOutput(qint64 bytes)
+{
+	Budget *budget = currentBudget;
+	if (budget == nullptr)
+		return true;
+
+	if (budget->m_limits.outputBytes > 0 && bytes > budget->m_limits.outputBytes)
+		return budget->fail(QString{"document exceeds the limit of %1 output bytes"}.arg(budget->m_limits.outputBytes));
+	return !budget->m_exceeded;
+}
+
+/*
+ * Called once per loop iteration, so the clock is only read on every 256th
+ * call of a thread.
+ */
+bool Budget::check()
+{
+	Budget *budget = currentBudget;
+	if (budget == nullptr)
+		return true;
+	if (budget->m_exceeded)
+		return false;
+
+	thread_local quint32 calls = 0;
+	const qint64 limit = budget->m_limits.milliseconds;
+	if (limit > 0 && (++calls % 256) == 0 && budget->m_timer.hasExpired(limit))
+		return budget->fail(QString{"document exceeds the time limit of %1 ms"}.arg(limit));
+	return true;
+}
+
+Budget * Budget::current()
+{
+	return currentBudget;
+}
+
+QString Budget::error() const
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	return m_error;
+}
+
+qint64 Budget::nodes() const
+{
+	return m_nodes;
+}
+
+qint64 Budget::elapsed() const
+{
+	return m_timer.elapsed();
+}
+
+bool Budget::fail(const QString &error)
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	if (!m_exceeded.exchange(true))
+		m_error = error;
+	return false;
+}
+
+Budget::Scope::Scope(Budget *budget) : m_outer{currentBudget}
+{
+	currentBudget = budget;
+}
+
+Budget::Scope::~Scope()
+{
+	currentBudget = m_outer;
+}
+
+Budget::Nesting::Nesting()
+{
+	const int depth = ++nesting;
+	Budget *budget = currentBudget;
+	int limit = budget != nullptr ? budget->m_limits.depth : 0;
+	if (limit <= 0)
+		limit = Limits{}.depth;
+
+	if (depth <= limit) {
+		m_ok = budget == nullptr || !budget->m_exceeded;
+		return;
+	}
+
+	// the stack is at stake, so the limit holds without a budget too
+	const QString error = QString{"document exceeds the nesting limit of %1"}.arg(limit);
+	if (budget != nullptr) {
+		m_ok = budget->fail(error);
+	} else {
+		Diagnostics::error(error);
+		m_ok = false;
+	}
+}
+
+Budget::Nesting::~Nesting()
+{
+	--nesting;
+}
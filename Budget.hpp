@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <QtCore>
+
+/*
+ * Resource limits of a single conversion; zero means unlimited, except for
+ * depth, where it means the default.
+ */
+struct Limits {
+	qint64 milliseconds = 0;
+	qint64 nodes = 0; // AST nodes created, macro expansions included
+	qint64 outputBytes = 0; // document body
+	int depth = 1000; // parser recursion on one thread, keeps a nested document off the end of the stack
+};
+
+/*
+ * Cooperative enforcement of Limits. The parser and the emitter check the
+ * budget of the current thread as they go and unwind with an error once it
+ * is spent, so a runaway document fails without taking the process down.
+ * Threads working on the same conversion share one budget through Scope;
+ * without a budget in scope every check passes.
+ */
+class Budget {
+public:
+	explicit Budget(const Limits &limits);
+
+	/* All of these fail from the moment any limit has been exceeded. */
+	static bool addNodes(qint64 count);
+	static bool checkOutput(qint64 bytes);
+	static bool check();
+
+	static Budget * current();
+	QString error() const;
+	qint64 nodes() const;
+	qint64 elapsed() const; // milliseconds since construction
+
+	class Scope {
+	public:
+		explicit Scope(Budget *budget);
+		~Scope();
+
+	private:
+		Budget *m_outer;
+	};
+
+	/*
+	 * One level of parser recursion on the current thread, for as long as it
+	 * lives. Going deeper than Limits::depth fails the budget; without a
+	 * budget in scope the default depth applies and the level reports an
+	 * error of its own.
+	 */
+	class Nesting {
+	public:
+		Nesting();
+		~Nesting();
+
+		bool ok() const { return m_ok; }
+
+	private:
+		bool m_ok;
+	};
+
+private:
+	bool fail(const QString &error);
+
+	Limits m_limits;
+	QElapsedTimer m_timer;
+	std::atomic <qint64> m_nodes{0};
+	std::atomic <bool> m_exceeded{false};
+	mutable std::mutex m_mutex;
+	QString m_error;
+};
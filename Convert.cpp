@@ -0,0 +1,302 @@
+#include <fcntl.h>
+#include <future>
+#include <memory>
+#include <unistd.h>
+
+#include "Convert.hpp"
+#include "Depends.hpp"
+#include "Diagnostics.hpp"
+#include "Document.hpp"
+#include "Metrics.hpp"
+#include "Output/Flat.hpp"
+#include "Output/Package.hpp"
+#include "Output/Sink.hpp"
+#include "Parser/LaTeXParser.hpp"
+#include "Parser/MarkdownParser.hpp"
+#include "Stats.hpp"
+#include "Tasks.hpp"
+
+namespace Odtgen {
+
+namespace {
+
+/*
+ * Forwards to `out`, counting the bytes for Metrics.
+ */
+class CountingSink : public Sink {
+public:
+	explicit CountingSink(Sink &out) : m_out{out} {}
+
+	qint64 count() const { return m_count; }
+
+private:
+	void doWrite(const char *data, qint64 size) override
+	{
+		m_count += size;
+		m_out.write(data, size);
+	}
+
+	bool doFinish() override
+	{
+		return m_out.finish();
+	}
+
+	Sink &m_out;
+	qint64 m_count = 0;
+};
+
+int level(const Options &options)
+{
+	return options.draft ? 0 : options.level;
+}
+
+/*
+ * Written aside and renamed when complete, like the outputs of a queue.
+ */
+bool writeChapter(const Document &chapter, const Options &options, const QString &path)
+{
+	const QString part = path + ".part";
+	const int fd = ::open(QFile::encodeName(part).constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		Diagnostics::error(QString{"unable to open chapter file: %1"}.arg(part));
+		return false;
+	}
+
+	bool result;
+	{
+		FdSink out{fd};
+		result = writeOdt(chapter, options.tmpl, out, level(options), 1);
+		result = out.finish() && result;
+	}
+	::close(fd);
+
+	if (result && ::rename(QFile::encodeName(part).constData(), QFile::encodeName(path).constData()) != 0) {
+		Diagnostics::error(QString{"unable to rename %1 to %2"}.arg(part, path));
+		result = false;
+	}
+	if (!result)
+		QFile::remove(part);
+	return result;
+}
+
+/*
+ * The chapters are written in parallel, on up to options.threads threads,
+ * while the master goes to `out`. <chapterBase>.chapters records a fingerprint per chapter,
+ * and a chapter that still matches the record of the previous run is left
+ * as it is: after editing one chapter only that one is written again.
+ */
+bool writeSplit(Document &doc, const Options &options, Sink &out)
+{
+	std::vector <Document> chapters = doc.splitSections();
+
+	QCryptographicHash setup{QCryptographicHash::Sha256};
+	for (const QByteArray &part : {options.tmpl.contentHeader, options.tmpl.contentFooter, options.tmpl.styles, options.tmpl.meta})
+		setup.addData(part);
+	setup.addData(QByteArray::number(level(options)));
+	const QByteArray setupKey = setup.result();
+
+	const QString recordPath = options.chapterBase + ".chapters";
+	QHash <QString, QByteArray> previous;
+	QFile recordFile{recordPath};
+	if (recordFile.open(QIODevice::ReadOnly)) {
+		for (const QByteArray &line : recordFile.readAll().split('\n')) {
+			const int space = line.indexOf(' ');
+			if (space > 0)
+				previous.insert(QFile::decodeName(line.mid(space + 1)), line.left(space));
+		}
+		recordFile.close();
+	}
+
+	QStringList names;
+	QByteArray record;
+	QThreadPool pool;
+	pool.setMaxThreadCount(options.threads);
+	std::vector <std::future <bool> > writers;
+	for (int i = 0; i < static_cast<int>(chapters.size()); ++i) {
+		const QString path = QString{"%1-%2.odt"}.arg(options.chapterBase).arg(i + 1, 2, 10, QChar{'0'});
+		const QString name = QFileInfo{path}.fileName();
+		names.append(name);
+
+		QCryptographicHash hash{QCryptographicHash::Sha256};
+		hash.addData(setupKey);
+		hash.addData(chapters[i].fingerprint());
+		const QByteArray key = hash.result().toHex();
+		record += key + ' ' + QFile::encodeName(name) + '\n';
+		if (previous.value(name) == key && QFileInfo::exists(path)) {
+			Stats::add("split.chapters.unchanged", 1);
+			continue;
+		}
+
+		writers.push_back(runTask(pool, [&chapter = chapters[i], &options, path, budget = Budget::current(), depends = Depends::current(), diagnostics = Diagnostics::current(), stats = Stats::current()](){
+			Budget::Scope budgetScope{budget};
+			Depends::Scope dependsScope{depends};
+			Diagnostics::Scope diagnosticsScope{diagnostics};
+			Stats::Scope statsScope{stats};
+			return writeChapter(chapter, options, path);
+		}));
+	}
+	Stats::add("split.chapters", chapters.size());
+
+	bool result = writeMaster(doc, names, options.tmpl, out, level(options), options.threads);
+	for (std::future <bool> &writer : writers)
+		result = writer.get() && result;
+
+	// a chapter that failed must not be taken for up to date next time
+	QSaveFile recordOut{recordPath};
+	if (!result || !recordOut.open(QIODevice::WriteOnly) || recordOut.write(record) != record.size() || !recordOut.commit())
+		QFile::remove(recordPath);
+	return result;
+}
+
+bool write(Document &doc, const Options &options, Sink &out)
+{
+	switch (options.output) {
+		case OutputFormat::Body:
+			return doc.output(out);
+		case OutputFormat::Odt:
+			return writeOdt(doc, options.tmpl, out, level(options), options.threads);
+		case OutputFormat::Flat:
+			return writeFlat(doc, options.tmpl, out);
+		case OutputFormat::Master:
+			return writeSplit(doc, options, out);
+	}
+	return false;
+}
+
+/*
+ * The parser runs on a thread of its own and feeds the emitter through the
+ * document's event queue. Title, images and formulas are moved over before
+ * the End event, so they are in place once output() has returned.
+ */
+bool streamConvert(Parser &parser, const QByteArray &input, const Options &options, Sink &out, Metrics::Failure &failure)
+{
+	Document doc;
+	doc.stream = std::make_shared<EventQueue>();
+
+	std::future <bool> parsed = std::async(std::launch::async, [&parser, &input, &doc, budget = Budget::current(), depends = Depends::current(), diagnostics = Diagnostics::current(), stats = Stats::current()](){
+		Budget::Scope budgetScope{budget};
+		Depends::Scope dependsScope{depends};
+		Diagnostics::Scope diagnosticsScope{diagnostics};
+		Stats::Scope statsScope{stats};
+		std::optional <Document> result = parser.parse(input, doc.stream.get());
+		if (result) {
+			doc.title = std::move(result->title);
+			doc.images = std::move(result->images);
+			doc.formulas = std::move(result->formulas);
+		} else {
+			Diagnostics::error("unable to parse the input");
+		}
+		doc.stream->push(Event{Event::Kind::End, Node{}, result.has_value()});
+		return result.has_value();
+	});
+
+	const bool result = write(doc, options, out);
+	const bool ok = parsed.get();
+	if (!ok)
+		failure = Metrics::Failure::Parse;
+	return ok && result;
+}
+
+bool doConvert(const QByteArray &input, InputFormat format, const Options &options, Sink &out, Metrics::Failure &failure)
+{
+	failure = Metrics::Failure::Usage;
+	if (options.output != OutputFormat::Body && options.tmpl.contentHeader.isEmpty()) {
+		Diagnostics::error("odt and flat output require a template");
+		return false;
+	}
+
+	std::unique_ptr <Parser> parser;
+	if (format == InputFormat::Markdown) {
+		parser = std::make_unique<MarkdownParser>();
+	} else {
+		auto latexParser = std::make_unique<LaTeXParser>();
+		for (const QString &filename : options.macroFiles) {
+			if (!latexParser->loadMacros(filename))
+				return false;
+		}
+		parser = std::move(latexParser);
+	}
+	parser->setDraft(options.draft);
+	parser->setBaseDir(options.baseDir);
+
+	// flat output writes the title into its header, before the body; a master needs the whole tree to split
+	failure = Metrics::Failure::Output;
+	if (options.streaming && options.output != OutputFormat::Flat && options.output != OutputFormat::Master) {
+		const bool result = streamConvert(*parser, input, options, out, failure);
+		return out.finish() && result;
+	}
+
+	std::optional <Document> doc = parser->parse(input);
+	if (!doc) {
+		Diagnostics::error("unable to parse the input");
+		failure = Metrics::Failure::Parse;
+		return false;
+	}
+	if (!options.draft)
+		doc->coalesce();
+
+	const bool result = write(*doc, options, out);
+	return out.finish() && result;
+}
+
+}
+
+bool convert(const QByteArray &input, InputFormat format, const Options &options, Sink &out, QString &error, QStringList &warnings)
+{
+	Diagnostics diagnostics;
+	Budget budget{options.limits};
+	CountingSink counted{out};
+	Metrics::Failure failure;
+	if (options.depends != nullptr && options.output != OutputFormat::Body) {
+		for (auto iter = options.tmpl.files.cbegin(); iter != options.tmpl.files.cend(); ++iter)
+			options.depends->add(iter.key(), iter.value());
+	}
+
+	Stats::Scope statsScope{options.stats};
+	bool result;
+	{
+		Budget::Scope budgetScope{&budget};
+		Depends::Scope dependsScope{options.depends};
+		Diagnostics::Scope diagnosticsScope{&diagnostics};
+		result = doConvert(input, format, options, counted, failure);
+	}
+	QStringList errors = diagnostics.errors();
+	if (!budget.error().isEmpty()) {
+		errors.prepend(budget.error());
+		failure = Metrics::Failure::Budget;
+	}
+
+	Metrics::add(Metrics::Counter::Documents);
+	Metrics::add(Metrics::Counter::BytesIn, input.size());
+	Metrics::add(Metrics::Counter::BytesOut, counted.count());
+	if (!result)
+		Metrics::fail(failure);
+
+	Stats::add("convert.documents", 1);
+	Stats::add(result ? "convert.documents.ok" : "convert.documents.failed", 1);
+	Stats::add("convert.bytes.in", input.size());
+	Stats::add("convert.bytes.out", counted.count());
+	Stats::add("convert.nodes", budget.nodes());
+	Stats::add("convert.milliseconds", budget.elapsed());
+
+	// what went wrong in a conversion that succeeded did not stop it
+	if (result) {
+		error.clear();
+		warnings = diagnostics.messages();
+	} else {
+		error = errors.join('\n');
+		warnings = diagnostics.warnings();
+	}
+	return result;
+}
+
+Result convert(const QByteArray &input, InputFormat format, const Options &options)
+{
+	Result result;
+	BufferSink out;
+	result.ok = convert(input, format, options, out, result.error, result.warnings);
+	result.data = out.take();
+	return result;
+}
+
+} // Odtgen
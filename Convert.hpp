@@ -0,0 +1,68 @@
+#pragma once
+
+#include <QtCore>
+#include <zlib.h>
+
+#include "Budget.hpp"
+#include "Output/Template.hpp"
+
+class Depends;
+class Sink;
+class Stats;
+
+/*
+ * Buffer-to-buffer conversion API of libodtgen. A call keeps its budget,
+ * counters and diagnostics in objects of its own, which the threads it
+ * starts share through scopes, so independent conversions may run
+ * concurrently on any number of threads. Diagnostics are collected into the
+ * result instead of being printed, and no error terminates the process.
+ * Process-wide are only the live counters of all conversions that
+ * Metrics::serve() exposes.
+ */
+namespace Odtgen {
+
+enum class InputFormat {
+	LaTeX,
+	Markdown,
+};
+
+enum class OutputFormat {
+	Body, // the text:* elements of the document body
+	Odt, // a complete .odt package
+	Flat, // a single flat ODF (.fodt) document
+	Master, // an .odm master document linking one .odt per top-level section
+};
+
+struct Options {
+	OutputFormat output = OutputFormat::Body;
+	Template tmpl; // required for Odt and Flat output
+	QStringList macroFiles;
+	int level = Z_DEFAULT_COMPRESSION;
+	int threads = 1;
+	Limits limits; // per conversion, see Budget
+	bool streaming = false; // parse and emit concurrently, without the full AST; not for Flat output
+	bool draft = false; // for previews: no highlighting or typography, stored package entries
+	Depends *depends = nullptr; // if set, receives every file the conversion reads
+	Stats *stats = nullptr; // if set, receives the counters of the conversion
+	QString baseDir; // relative file names in the document are taken relative to it; empty for the working directory
+	QString chapterBase; // Master: chapter n goes to <chapterBase>-<n>.odt, next to the master
+};
+
+struct Result {
+	bool ok = false;
+	QByteArray data;
+	QString error; // why the conversion failed
+	QStringList warnings; // what was reported without stopping the conversion
+};
+
+Result convert(const QByteArray &input, InputFormat format, const Options &options);
+
+/*
+ * Streaming variant: the output is written to `out` as it is generated and
+ * `out` is finished before returning. On failure `error` holds the
+ * diagnostics and `out` may contain a partial document; `warnings` is set
+ * like that of Result.
+ */
+bool convert(const QByteArray &input, InputFormat format, const Options &options, Sink &out, QString &error, QStringList &warnings);
+
+} // Odtgen
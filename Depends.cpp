@@ -0,0 +1,160 @@
+#include "Depends.hpp"
+#include "Diagnostics.hpp"
+#include "Stats.hpp"
+
+namespace {
+
+thread_local Depends *currentDepends = nullptr;
+
+// first line of a manifest, followed by the key of the run
+const QByteArray Header = "odtgen-depends 2 ";
+// in place of the hash of a file that was not found
+const QByteArray Absent = "absent";
+
+QByteArray hashData(const QByteArray &data)
+{
+	return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+}
+
+QByteArray hashFile(const QString &path)
+{
+	QFile file{path};
+	if (!file.open(QIODevice::ReadOnly))
+		return {};
+
+	QCryptographicHash hash{QCryptographicHash::Sha256};
+	if (!hash.addData(&file))
+		return {};
+	return hash.result().toHex();
+}
+
+}
+
+void Depends::add(const QString &path, const QByteArray &data)
+{
+	insert(path, hashData(data));
+}
+
+void Depends::addAbsent(const QString &path)
+{
+	insert(path, Absent);
+}
+
+bool Depends::addFile(const QString &path)
+{
+	const QByteArray hash = hashFile(path);
+	if (hash.isEmpty()) {
+		Diagnostics::error(QString{"depends: unable to read: %1"}.arg(path));
+		return false;
+	}
+	insert(path, hash);
+	return true;
+}
+
+void Depends::insert(const QString &path, const QByteArray &hash)
+{
+	const QString absolute = QFileInfo{path}.absoluteFilePath();
+	std::lock_guard <std::mutex> lock{m_mutex};
+	if (!m_files.contains(absolute))
+		m_files.insert(absolute, hash);
+	else if (m_files.value(absolute) != hash && m_changed.isEmpty())
+		m_changed = absolute;
+}
+
+void Depends::record(const QString &path, const QByteArray &data)
+{
+	if (currentDepends != nullptr)
+		currentDepends->add(path, data);
+}
+
+void Depends::recordAbsent(const QString &path)
+{
+	if (currentDepends != nullptr)
+		currentDepends->addAbsent(path);
+}
+
+Depends * Depends::current()
+{
+	return currentDepends;
+}
+
+QByteArray Depends::key(const QByteArray &input, const QStringList &arguments)
+{
+	QCryptographicHash hash{QCryptographicHash::Sha256};
+	hash.addData(input);
+	for (const QString &argument : arguments) {
+		hash.addData("\0", 1);
+		hash.addData(argument.toUtf8());
+	}
+	return hash.result().toHex();
+}
+
+/*
+ * Every listed file is hashed again; a missing or unreadable one, like a
+ * missing manifest, means the output has to be regenerated, and so does
+ * one that was absent and exists now.
+ */
+bool Depends::upToDate(const QString &manifest, const QByteArray &key)
+{
+	QFile file{manifest};
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+	if (file.readLine().trimmed() != Header + key)
+		return false;
+
+	qint64 files = 0;
+	while (!file.atEnd()) {
+		const QByteArray line = file.readLine();
+		const int space = line.indexOf(' ');
+		if (space == -1)
+			return false;
+
+		QByteArray path = line.mid(space + 1);
+		if (path.endsWith('\n'))
+			path.chop(1);
+		const QString filename = QFile::decodeName(path);
+		const QByteArray hash = line.left(space);
+		if (hash == Absent ? QFileInfo::exists(filename) : hashFile(filename) != hash)
+			return false;
+		++files;
+	}
+
+	Stats::set("depends.files.checked", files);
+	return true;
+}
+
+/*
+ * The manifest vouches for the contents the conversion read, so it is not
+ * written if a file changed while the conversion was running.
+ */
+bool Depends::write(const QString &manifest, const QByteArray &key) const
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	if (!m_changed.isEmpty()) {
+		Diagnostics::warning(QString{"depends: %1 changed during the run, not writing %2"}.arg(m_changed, manifest));
+		return true;
+	}
+
+	QByteArray data = Header + key + '\n';
+	for (auto iter = m_files.cbegin(); iter != m_files.cend(); ++iter)
+		data += iter.value() + ' ' + QFile::encodeName(iter.key()) + '\n';
+
+	QSaveFile file{manifest};
+	if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+		Diagnostics::error(QString{"depends: unable to write: %1"}.arg(manifest));
+		return false;
+	}
+
+	Stats::set("depends.files.recorded", m_files.count());
+	return true;
+}
+
+Depends::Scope::Scope(Depends *depends) : m_outer{currentDepends}
+{
+	currentDepends = depends;
+}
+
+Depends::Scope::~Scope()
+{
+	currentDepends = m_outer;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <mutex>
+#include <QtCore>
+
+/*
+ * The files a conversion reads: sources, macros, templates and images.
+ * Each is hashed as it is read, and after a successful run the hashes are
+ * written to a manifest next to the output; a later run with the same
+ * input and arguments is skipped for as long as none of them changed.
+ * Files looked for but not found are recorded as absent, so that creating
+ * one brings the output up to date again. Threads working on the same
+ * conversion share one set through Scope.
+ */
+class Depends {
+public:
+	/* `data` is the content as read; a file read twice with different contents spoils the manifest. */
+	void add(const QString &path, const QByteArray &data);
+	void addAbsent(const QString &path);
+	bool addFile(const QString &path); // reads the file now
+
+	/* These go to the set in scope of the current thread, if any. */
+	static void record(const QString &path, const QByteArray &data);
+	static void recordAbsent(const QString &path);
+	static Depends * current();
+
+	/* Identifies one run by its input and command line. */
+	static QByteArray key(const QByteArray &input, const QStringList &arguments);
+	static bool upToDate(const QString &manifest, const QByteArray &key);
+	bool write(const QString &manifest, const QByteArray &key) const;
+
+	class Scope {
+	public:
+		explicit Scope(Depends *depends);
+		~Scope();
+
+	private:
+		Depends *m_outer;
+	};
+
+private:
+	void insert(const QString &path, const QByteArray &hash);
+
+	mutable std::mutex m_mutex;
+	QMap <QString, QByteArray> m_files; // absolute path -> hash, Absent if not found
+	QString m_changed; // a file read twice with different contents
+};
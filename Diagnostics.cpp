@@ -0,0 +1,74 @@
+#include "Diagnostics.hpp"
+
+namespace {
+
+thread_local Diagnostics *currentDiagnostics = nullptr;
+
+}
+
+void Diagnostics::warning(const QString &message)
+{
+	if (currentDiagnostics != nullptr)
+		currentDiagnostics->add(false, message);
+	else
+		qWarning().noquote() << message;
+}
+
+void Diagnostics::error(const QString &message)
+{
+	if (currentDiagnostics != nullptr)
+		currentDiagnostics->add(true, message);
+	else
+		qCritical().noquote() << message;
+}
+
+Diagnostics * Diagnostics::current()
+{
+	return currentDiagnostics;
+}
+
+QStringList Diagnostics::warnings() const
+{
+	return filter(false);
+}
+
+QStringList Diagnostics::errors() const
+{
+	return filter(true);
+}
+
+QStringList Diagnostics::messages() const
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	QStringList result;
+	for (const Message &message : m_messages)
+		result.append(message.text);
+	return result;
+}
+
+void Diagnostics::add(bool error, const QString &message)
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	m_messages.push_back(Message{error, message});
+}
+
+QStringList Diagnostics::filter(bool errors) const
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	QStringList result;
+	for (const Message &message : m_messages) {
+		if (message.error == errors)
+			result.append(message.text);
+	}
+	return result;
+}
+
+Diagnostics::Scope::Scope(Diagnostics *diagnostics) : m_outer{currentDiagnostics}
+{
+	currentDiagnostics = diagnostics;
+}
+
+Diagnostics::Scope::~Scope()
+{
+	currentDiagnostics = m_outer;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include <QtCore>
+
+/*
+ * The warnings and errors of one conversion. Library code reports through
+ * warning() and error() to the Diagnostics in scope of the current thread;
+ * threads working on the same conversion share one through Scope. Without a
+ * Diagnostics in scope a message goes to qWarning() or qCritical(), so code
+ * that runs outside of a conversion still reports as before.
+ */
+class Diagnostics {
+public:
+	static void warning(const QString &message);
+	static void error(const QString &message);
+	static Diagnostics * current();
+
+	QStringList warnings() const;
+	QStringList errors() const;
+	QStringList messages() const; // both, in the order they were reported
+
+	class Scope {
+	public:
+		explicit Scope(Diagnostics *diagnostics);
+		~Scope();
+
+	private:
+		Diagnostics *m_outer;
+	};
+
+private:
+	struct Message {
+		bool error;
+		QString text;
+	};
+
+	void add(bool error, const QString &message);
+	QStringList filter(bool errors) const;
+
+	mutable std::mutex m_mutex;
+	std::vector <Message> m_messages;
+};
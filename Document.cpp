@@ -1,95 +1,483 @@
-#include <unordered_set>
-
+#include "AllocStats.hpp"
+#include "Budget.hpp"
+#include "Diagnostics.hpp"
 #include "Document.hpp"
+#include "Keywords.hpp"
+#include "Metrics.hpp"
+#include "Output/Sink.hpp"
+#include "Stats.hpp"
 #include "Strings.hpp"
 #include "Vector.hpp"
 #include "XmlGen.hpp"
 
-namespace std {
+namespace {
+
+bool isBlock(const QByteArray &keyword)
+{
+	return Keywords::find(keyword).flags & Keywords::Block;
+}
+
+bool isList(const QByteArray &keyword)
+{
+	return Keywords::find(keyword).flags & Keywords::List;
+}
+
+bool ignore(const QByteArray &keyword)
+{
+	return Keywords::find(keyword).flags & Keywords::Ignored;
+}
+
+bool isCacheable(const Node &n)
+{
+	return n.type == Node::Type::Environment || (n.type == Node::Type::Fragment && isBlock(n.value));
+}
+
+bool isTag(const Node &n, const char *name)
+{
+	return n.type == Node::Type::Tag && n.value == name;
+}
 
-template <>
-struct hash<QString> {
-	size_t operator () (const QString &s) const noexcept { return qHash(s); }
+/*
+ * A part of the tree that is emitted from the cache when it repeats: a block
+ * subtree, or the siblings from a CodeStart tag to its CodeEnd, which make up
+ * one code frame.
+ */
+struct Unit {
+	const Node *first;
+	int count;
+	quint64 key;
 };
 
+/*
+ * Node count and value bytes of the subtree rooted at `n`: equal subtrees
+ * measure the same, and measuring hashes no text. The units found on the way
+ * are appended to `units`, keyed by their measure.
+ */
+quint64 measure(const Node &n, QVector <Unit> &units)
+{
+	quint64 result = (quint64{1} << 32) + n.value.size();
+	int runStart = -1;
+	quint64 run = 0;
+	for (int i = 0; i < n.children.count(); ++i) {
+		const Node &child = n.children[i];
+		const quint64 size = measure(child, units);
+		result += size;
+
+		if (isTag(child, Strings::CodeStart)) {
+			runStart = i;
+			run = 0;
+		}
+		if (runStart == -1)
+			continue;
+		run += size;
+		if (isTag(child, Strings::CodeEnd)) {
+			units.append(Unit{&n.children[runStart], i - runStart + 1, run | (quint64{1} << 63)});
+			runStart = -1;
+		}
+	}
+
+	if (isCacheable(n))
+		units.append(Unit{&n, 1, result ^ (quint64{qHash(n.value)} << 40)});
+	return result;
 }
 
-namespace {
+quint64 hashSubtree(const Node &n)
+{
+	quint64 result = (quint64{qHash(n.value)} << 16) ^ (quint64{static_cast<quint8>(n.type)} << 1) ^ n.endParagraph;
+	for (const Node &child : n.children)
+		result = (result ^ hashSubtree(child)) * 1099511628211ull;
+	return result;
+}
 
-bool isBlock(const QString &keyword)
+/*
+ * The units under `root` that occur more than once, by their first node and
+ * keyed by a structural hash. Only units sharing their measure with another
+ * one are hashed, so a document without repetitions costs one walk over the
+ * tree and no hashing.
+ */
+QHash <const Node *, Unit> repeatedUnits(const Node &root)
 {
-	static const std::unordered_set <QString> Keywords {
-		Strings::CodeLine,
-		Strings::Paragraph,
-		Strings::Section,
-		Strings::Subsection,
-		Strings::Title,
-	};
+	QVector <Unit> units;
+	measure(root, units);
+	QHash <quint64, int> measures;
+	for (const Unit &unit : units)
+		++measures[unit.key];
+
+	QVector <Unit> candidates;
+	QHash <quint64, int> occurrences;
+	for (Unit unit : units) {
+		if (measures.value(unit.key) < 2)
+			continue;
+		quint64 hash = unit.count;
+		for (int i = 0; i < unit.count; ++i)
+			hash = (hash ^ hashSubtree(unit.first[i])) * 1099511628211ull;
+		unit.key = hash;
+		++occurrences[hash];
+		candidates.append(unit);
+	}
+
+	QHash <const Node *, Unit> result;
+	for (const Unit &unit : candidates) {
+		if (occurrences.value(unit.key) > 1)
+			result.insert(unit.first, unit);
+	}
+	return result;
+}
 
-	return Keywords.find(keyword) != Keywords.end();
+bool isSpan(const Node &n)
+{
+	return n.type == Node::Type::Fragment && !isBlock(n.value) && *entryText(n.value) != '\0';
 }
 
-bool isList(const QString &keyword)
+int spanBytes(const QByteArray &style)
 {
-	static const std::unordered_set <QString> Keywords {
-		Strings::Enumerate,
-		Strings::Itemize,
-	};
+	return qstrlen(entryText(style)) + qstrlen(exitText(style));
+}
 
-	return Keywords.find(keyword) != Keywords.end();
+/*
+ * Text and spans only: nothing that ends a paragraph or changes the
+ * emitter's state, so more content may be appended inside.
+ */
+bool isInline(const Node &n)
+{
+	if (n.endParagraph || (n.type != Node::Type::Text && !isSpan(n)))
+		return false;
+	return std::all_of(n.children.begin(), n.children.end(), isInline);
 }
 
-bool ignore(const QString &keyword)
+bool isEmptySpan(const Node &n)
 {
-	static const std::unordered_set <QString> Keywords {
-		Strings::Input,
-		Strings::SourceCode,
+	if (!isSpan(n) || n.endParagraph)
+		return false;
+	return std::all_of(n.children.begin(), n.children.end(), [](const Node &child){
+		return child.type == Node::Type::Text && child.value.isEmpty() && !child.endParagraph;
+	});
+}
+
+struct Coalescing {
+	void report() const
+	{
+		Stats::add("coalesce.spans.merged", merged);
+		Stats::add("coalesce.spans.dropped", dropped);
+		Stats::add("coalesce.bytes.saved", bytes);
+	}
+
+	qint64 merged = 0;
+	qint64 dropped = 0;
+	qint64 bytes = 0;
+};
+
+/*
+ * Appends `text` to `to`, fusing a span that closes `to` with the same span
+ * opening `text`, as in consecutive Cpp::markup() snippets.
+ */
+void joinText(QByteArray &to, const QByteArray &text, Coalescing &stats)
+{
+	static const QByteArray SpanStart{"<text:span "};
+	static const QByteArray SpanEnd{"</text:span>"};
+
+	const int open = to.lastIndexOf(SpanStart);
+	const int openEnd = to.indexOf('>', open);
+	const bool fuse = open != -1 && openEnd != -1 && to.endsWith(SpanEnd) && to.indexOf("</", openEnd) == to.size() - SpanEnd.size()
+		&& text.startsWith(QByteArray::fromRawData(to.constData() + open, openEnd - open + 1));
+	if (!fuse) {
+		to += text;
+		return;
+	}
+
+	const int openSize = openEnd - open + 1;
+	to.chop(SpanEnd.size());
+	to.append(text.constData() + openSize, text.size() - openSize);
+	++stats.merged;
+	stats.bytes += SpanEnd.size() + openSize;
+}
+
+/*
+ * One pass over the children of `n`: empty spans go away, a span is merged
+ * into a preceding sibling of the same style and adjacent text is joined.
+ */
+void coalesceChildren(Node &n, Coalescing &stats)
+{
+	Vector <Node> result;
+	result.reserve(n.children.count());
+	QVector <int> grown;
+	bool lastInline = false;
+
+	for (Node &child : n.children) {
+		if (isEmptySpan(child)) {
+			++stats.dropped;
+			stats.bytes += spanBytes(child.value);
+			continue;
+		}
+
+		if (!result.empty()) {
+			Node &last = result.back();
+			if (lastInline && isSpan(last) && isSpan(child) && qstrcmp(entryText(last.value), entryText(child.value)) == 0) {
+				lastInline = isInline(child);
+				last.children.reserveMore(child.children.count());
+				for (Node &grandchild : child.children)
+					last.children.push_back(std::move(grandchild));
+				if (grown.empty() || grown.back() != result.count() - 1)
+					grown.append(result.count() - 1);
+				++stats.merged;
+				stats.bytes += spanBytes(child.value);
+				continue;
+			}
+			if (last.type == Node::Type::Text && child.type == Node::Type::Text && !last.endParagraph) {
+				joinText(last.value, child.value, stats);
+				last.endParagraph = child.endParagraph;
+				continue;
+			}
+		}
+
+		lastInline = isInline(child);
+		result.push_back(std::move(child));
+	}
+
+	/* the seams of merged spans may hold more to coalesce */
+	for (const int idx : grown)
+		coalesceChildren(result[idx], stats);
+	n.children = std::move(result);
+}
+
+void coalesce(Node &n, Coalescing &stats)
+{
+	for (Node &child : n.children)
+		coalesce(child, stats);
+	coalesceChildren(n, stats);
+}
+
+/*
+ * Forwards everything to `out`, keeping a copy of what is written between
+ * beginRecording() and the matching endRecording(). Recordings may nest.
+ */
+class RecordingSink : public Sink {
+public:
+	explicit RecordingSink(Sink &out) : m_out{out} {}
+
+	int beginRecording()
+	{
+		++m_depth;
+		return m_recorded.size();
+	}
+
+	qint64 written() const
+	{
+		return m_written;
+	}
+
+	QByteArray endRecording(int mark)
+	{
+		QByteArray result = m_recorded.mid(mark);
+		if (--m_depth == 0)
+			m_recorded.clear();
+		return result;
+	}
+
+private:
+	void doWrite(const char *data, qint64 size) override
+	{
+		m_out.write(data, size);
+		m_written += size;
+		if (m_depth > 0)
+			m_recorded.append(data, size);
+	}
+
+	Sink &m_out;
+	QByteArray m_recorded;
+	qint64 m_written = 0;
+	int m_depth = 0;
+};
+
+bool isChapter(const Node &n)
+{
+	return (n.type == Node::Type::Fragment || n.type == Node::Type::Environment) && n.value == Strings::Section;
+}
+
+/*
+ * The images and formulas a subtree embeds, by their href in the package.
+ */
+void collectLinks(const Node &n, QSet <QString> &links)
+{
+	static const QByteArray Href = "xlink:href=\"";
+	if (n.type == Node::Type::Text) {
+		for (int idx = n.value.indexOf(Href); idx != -1; idx = n.value.indexOf(Href, idx)) {
+			idx += Href.size();
+			const int end = n.value.indexOf('"', idx);
+			if (end == -1)
+				break;
+			QByteArray link = n.value.mid(idx, end - idx);
+			if (link.startsWith("./"))
+				link.remove(0, 2);
+			links.insert(QString::fromUtf8(link));
+		}
+	}
+	for (const Node &child : n.children)
+		collectLinks(child, links);
+}
+
+void takeLinked(const Node &root, const Images &images, const Formulas &formulas, Document &doc)
+{
+	QSet <QString> links;
+	collectLinks(root, links);
+	for (const Image &image : images.all()) {
+		if (links.contains(image.href))
+			doc.images.insert(image);
+	}
+	for (const Formula &formula : formulas.all()) {
+		if (links.contains(formula.href))
+			doc.formulas.insert(formula);
+	}
+}
+
+void addNodes(QCryptographicHash &hash, const Node &n)
+{
+	hash.addData(QByteArray::number(static_cast<int>(n.type)) + ' ' + QByteArray::number(n.endParagraph) + ' '
+		+ QByteArray::number(n.value.size()) + ' ' + QByteArray::number(n.children.count()) + ':');
+	hash.addData(n.value);
+	for (const Node &child : n.children)
+		addNodes(hash, child);
+}
+
+}
+
+/*
+ * Highlighted code and \texttt leave long runs of back-to-back spans of one
+ * style; merging them shrinks content.xml without changing how it renders.
+ */
+void Document::coalesce()
+{
+	ALLOC_PHASE("coalesce");
+	Coalescing stats;
+	::coalesce(title, stats);
+	::coalesce(documentRoot, stats);
+	stats.report();
+}
+
+/*
+ * Text values are XML already and may hold whole frames (inline formulas),
+ * so tags are dropped and the parser's entities decoded to get plain text.
+ */
+QString Document::titleText() const
+{
+	QByteArray result;
+	std::function <void (const Node &)> collect = [&result, &collect](const Node &n){
+		if (n.type == Node::Type::Text)
+			result += n.value;
+		for (const Node &child : n.children)
+			collect(child);
 	};
 
-	return Keywords.find(keyword) != Keywords.end();
+	collect(title);
+
+	QByteArray plain;
+	plain.reserve(result.size());
+	for (int idx = 0; idx < result.size(); ++idx) {
+		if (result[idx] == '<') {
+			const int end = result.indexOf('>', idx);
+			if (end == -1)
+				break;
+			idx = end;
+		} else {
+			plain += result[idx];
+		}
+	}
+	plain.replace("&lt;", "<");
+	plain.replace("&gt;", ">");
+	plain.replace("&amp;", "&");
+	return QString::fromUtf8(plain).simplified();
 }
 
+/*
+ * Every top-level section, up to the next one, moves into a document of
+ * its own together with the images and formulas it shows; whatever comes
+ * before the first section stays here.
+ */
+std::vector <Document> Document::splitSections()
+{
+	std::vector <Document> result;
+	Vector <Node> front;
+	for (Node &child : documentRoot.children) {
+		if (isChapter(child))
+			result.emplace_back(title.clone(), Node{documentRoot.type, QByteArray{documentRoot.value}});
+		Vector <Node> &target = result.empty() ? front : result.back().documentRoot.children;
+		target.push_back(std::move(child));
+	}
+	documentRoot.children = std::move(front);
+
+	for (Document &chapter : result)
+		takeLinked(chapter.documentRoot, images, formulas, chapter);
+	Document rest;
+	takeLinked(documentRoot, images, formulas, rest);
+	images = std::move(rest.images);
+	formulas = std::move(rest.formulas);
+	return result;
 }
 
-void Document::output() const
+/*
+ * Changes with anything that shows in the output: the nodes, the title,
+ * and the images and formulas embedded.
+ */
+QByteArray Document::fingerprint() const
 {
-	QTextStream output{stdout};
+	QCryptographicHash hash{QCryptographicHash::Sha256};
+	addNodes(hash, title);
+	addNodes(hash, documentRoot);
+	for (const Image &image : images.all()) {
+		const QFileInfo info{image.source};
+		hash.addData((image.href + ' ' + image.source).toUtf8());
+		hash.addData(QByteArray::number(info.size()) + ' ' + QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+	}
+	for (const Formula &formula : formulas.all())
+		hash.addData(formula.href.toUtf8() + ' ' + formula.tex);
+	return hash.result();
+}
+
+bool Document::output(Sink &output) const
+{
+	ALLOC_PHASE("emit");
+	Metrics::PhaseTimer timer{Metrics::Phase::Emit};
 	struct {
-		void addText(const QString &text)
+		void addText(const QByteArray &text)
 		{
 			if (text.isEmpty())
 				return;
 
-			if (inCode && allWhitespace(text))
-				paragraph.append(QString{"<text:s text:c=\"%1\"/>"}.arg(text.length()));
+			if (inCode)
+				addCode(text);
 			else
 				paragraph.append(text);
 		}
 
-		decltype(auto) operator << (const QString &text)
+		void addText(const char *text)
+		{
+			addText(QByteArray::fromRawData(text, qstrlen(text)));
+		}
+
+		void addMarkup(const char *markup)
 		{
-			addText(text);
-			return *this;
+			flushCodeSpaces();
+			paragraph.append(markup);
 		}
 
-		QString push(const QString &env, int *level = nullptr)
+		QByteArray push(const QByteArray &env, int *level = nullptr)
 		{
 			if (level != nullptr)
 				*level = inside.count();
 			return doPush(env);
 		}
 
-		QString pop()
+		QByteArray pop()
 		{
 			if (inside.empty())
-				return QString{};
+				return QByteArray{};
 
 			return doPop();
 		}
 
-		QString pop(int level)
+		QByteArray pop(int level)
 		{
-			QString result;
+			QByteArray result;
 			while (inside.count() != level)
 				result += doPop();
 
@@ -113,21 +501,22 @@ void Document::output() const
 			listLevels.clear();
 			inside.clear();
 			paragraph.clear();
+			codeSpaces = 0;
 			inCode = false;
 		}
 
-		QString startCodeFrame()
+		QByteArray startCodeFrame()
 		{
-			QString result;
+			QByteArray result;
 			if (inParagraph())
 				result = pop();
 			inCode = true;
 			return result;
 		}
 
-		QString endCodeFrame()
+		QByteArray endCodeFrame()
 		{
-			QString result;
+			QByteArray result;
 			if (inParagraph()) {
 				if (paragraph.trimmed().isEmpty())
 					pop();
@@ -139,12 +528,13 @@ void Document::output() const
 		}
 
 		QVector <int> listLevels;
-		QVector <QString> inside;
-		QString paragraph;
+		QVector <QByteArray> inside;
+		QByteArray paragraph;
+		int codeSpaces = 0;
 		bool inCode = false;
 
 	private:
-		QString doPush(const QString &env)
+		QByteArray doPush(const QByteArray &env)
 		{
 			if (isList(env))
 				listLevels.push_back(inside.count());
@@ -156,19 +546,21 @@ void Document::output() const
 			}
 
 			if (isBlock(env))
-				return QString{};
+				return QByteArray{};
 			return entryText(env);
 		}
 
-		QString doPop()
+		QByteArray doPop()
 		{
-			QString result;
+			ALLOC_SITE("Document::doPop");
+			QByteArray result;
 			if (inParagraph()) {
+				flushCodeSpaces();
 				if (!paragraph.isEmpty() || inCode) {
-					if (inCode)
-						paragraph.replace("    ", "<text:s text:c=\"4\"/>");
-
-					result = QString{"%1%2%3"}.arg(entryText(inside.back())).arg(paragraph).arg(exitText(inside.back()));
+					result.reserve(paragraph.size() + 64);
+					result.append(entryText(inside.back()));
+					result.append(paragraph);
+					result.append(exitText(inside.back()));
 					paragraph.clear();
 				}
 			} else {
@@ -182,18 +574,62 @@ void Document::output() const
 			return result;
 		}
 
-		bool allWhitespace(const QString &text) const
+		/*
+		 * Code is rendered in a single forward pass: every run of spaces,
+		 * possibly spanning several text chunks, becomes one <text:s/> element
+		 * and markup embedded in the text is copied verbatim.
+		 */
+		void addCode(const QByteArray &text)
 		{
-			for (const QChar &c : text) {
-				if (!c.isSpace())
-					return false;
+			const char *run = text.constData();
+			const char *end = run + text.size();
+			bool inMarkup = false;
+
+			for (const char *c = run; c != end; ++c) {
+				if (inMarkup) {
+					inMarkup = (*c != '>');
+				} else if (*c == ' ') {
+					if (run != c)
+						paragraph.append(run, c - run);
+					++codeSpaces;
+					run = c + 1;
+				} else {
+					flushCodeSpaces();
+					inMarkup = (*c == '<');
+				}
 			}
-			return true;
+
+			if (run != end)
+				paragraph.append(run, end - run);
+		}
+
+		void flushCodeSpaces()
+		{
+			if (codeSpaces == 0)
+				return;
+
+			paragraph.append("<text:s text:c=\"");
+			paragraph.append(QByteArray::number(codeSpaces));
+			paragraph.append("\"/>");
+			codeSpaces = 0;
 		}
 
 	} context;
 
-	std::function <void (const Node &)> doOutput = [this, &output, &context, &doOutput](const Node &n){
+	const QHash <const Node *, Unit> repeated = repeatedUnits(documentRoot);
+
+	RecordingSink out{output};
+	bool ok = true;
+	Node streamedTitle;
+	const Node *titleNode = &title;
+	std::function <void (const Node &)> doOutput;
+	std::function <void (const Vector <Node> &)> doChildren;
+	std::function <void (const Node &)> emitNode = [&out, &context, &ok, &doOutput, &doChildren, &titleNode](const Node &n){
+		if (!ok || !Budget::check() || !Budget::checkOutput(out.written() + context.paragraph.size())) {
+			ok = false;
+			return;
+		}
+
 		if (n.type != Node::Type::Text && ignore(n.value))
 			return;
 
@@ -204,12 +640,11 @@ void Document::output() const
 		switch (outputMode) {
 			case Node::Type::Environment: {
 				if (context.inParagraph())
-					output << context.pop();
+					out << context.pop();
 				int level;
-				output << context.push(n.value, &level);
-				for (const Node &child : n.children)
-					doOutput(child);
-				output << context.pop(level);
+				out << context.push(n.value, &level);
+				doChildren(n.children);
+				out << context.pop(level);
 				break;
 			}
 			case Node::Type::Fragment: {
@@ -217,40 +652,42 @@ void Document::output() const
 				const bool isBlock = ::isBlock(n.value);
 
 				if (inParagraph && isBlock)
-					output << context.pop();
+					out << context.pop();
 				else if (!inParagraph && !isBlock)
-					output << context.push(Strings::Paragraph);
+					out << context.push(Strings::Paragraph);
 
 				if (isBlock)
-					output << context.push(n.value);
+					out << context.push(n.value);
 				else
-					context.addText(entryText(n.value));
+					context.addMarkup(entryText(n.value));
 
-				for (const Node &child : n.children)
-					doOutput(child);
+				doChildren(n.children);
 
 				if (isBlock)
-					output << context.pop();
+					out << context.pop();
 				else
-					context.addText(exitText(n.value));
+					context.addMarkup(exitText(n.value));
 
 				break;
 			}
 			case Node::Type::Tag:
 				if (n.value == Strings::MakeTitle) {
+					// Markdown has its title in the body, there is none to make
+					if (titleNode->type == Node::Type::Invalid)
+						break;
 					auto oldctx = context;
 					context.reset();
-					doOutput(this->title);
+					doOutput(*titleNode);
 					context = oldctx;
 				} else if (n.value == Strings::Item) {
-					output << context.pop(context.listLevels.back() + 1);
-					output << context.push(Strings::Item);
+					out << context.pop(context.listLevels.back() + 1);
+					out << context.push(Strings::Item);
 				} else if (n.value == Strings::Underscore) {
 					context.addText("_");
 				} else if (n.value == Strings::CodeStart) {
-					output << context.startCodeFrame();
+					out << context.startCodeFrame();
 				} else if (n.value == Strings::CodeEnd) {
-					output << context.endCodeFrame();
+					out << context.endCodeFrame();
 				} else if (n.value == Strings::Ldots) {
 					context.addText("…");
 				} else if (n.value == Strings::Tilde || n.value == Strings::CodeTilde) {
@@ -262,21 +699,143 @@ void Document::output() const
 				break;
 			case Node::Type::Text:
 				if (!context.inParagraph())
-					output << context.push(Strings::Paragraph);
+					out << context.push(Strings::Paragraph);
 
 				context.addText(n.value);
 
 				if (n.endParagraph)
-					output << context.pop();
+					out << context.pop();
 				break;
 			default:
-				qCritical() << QString{"Uknown type of node: %1"}.arg(static_cast<int>(n.type));
-				std::exit(1);
+				Diagnostics::error(QString{"Uknown type of node: %1"}.arg(static_cast<int>(n.type)));
+				ok = false;
 		}
 	};
 
-	doOutput(documentRoot);
+	/*
+	 * A repeated unit that starts and ends outside of any paragraph is
+	 * emitted once per entry context; further occurrences copy that XML.
+	 */
+	struct Emitted {
+		const Node *first;
+		int count;
+		bool inCode;
+		int listDepth;
+		QByteArray xml;
+	};
+	QHash <quint64, Emitted> cache;
+	qint64 hits = 0, misses = 0;
+
+	auto emitUnit = [&](const Unit &unit){
+		if (context.inParagraph() || !context.paragraph.isEmpty() || context.codeSpaces != 0) {
+			for (int i = 0; i < unit.count; ++i)
+				emitNode(unit.first[i]);
+			return;
+		}
+
+		const bool inCode = context.inCode;
+		const int depth = context.inside.count();
+		const int listDepth = context.listLevels.count();
+		const quint64 key = unit.key ^ (quint64{inCode} << 63) ^ (quint64(listDepth) << 48);
+
+		auto cached = cache.constFind(key);
+		if (cached != cache.constEnd() && cached->count == unit.count && cached->inCode == inCode && cached->listDepth == listDepth
+			&& std::equal(unit.first, unit.first + unit.count, cached->first)) {
+			out << cached->xml;
+			++hits;
+			return;
+		}
+
+		++misses;
+		const int mark = out.beginRecording();
+		for (int i = 0; i < unit.count; ++i)
+			emitNode(unit.first[i]);
+		QByteArray xml = out.endRecording(mark);
+
+		const bool restored = context.inside.count() == depth && context.listLevels.count() == listDepth
+			&& context.inCode == inCode && context.paragraph.isEmpty() && context.codeSpaces == 0;
+		if (restored && !cache.contains(key))
+			cache.insert(key, Emitted{unit.first, unit.count, inCode, listDepth, std::move(xml)});
+	};
+
+	doOutput = [&](const Node &n){
+		auto iter = repeated.constFind(&n);
+		if (iter == repeated.constEnd())
+			emitNode(n);
+		else
+			emitUnit(*iter);
+	};
+
+	doChildren = [&](const Vector <Node> &children){
+		for (int i = 0; i < children.count(); ++i) {
+			auto iter = repeated.constFind(&children[i]);
+			if (iter == repeated.constEnd()) {
+				emitNode(children[i]);
+				continue;
+			}
+
+			// a code frame ends the paragraph before it, which must not be recorded along
+			if (iter->count > 1 && context.inParagraph())
+				out << context.pop();
+			emitUnit(*iter);
+			i += iter->count - 1;
+		}
+	};
+
+	if (stream) {
+		/*
+		 * Same as emitting the root environment, spread over its events.
+		 * The queue is drained to the end even after a failure, so that
+		 * the parser never waits on a full queue.
+		 */
+		Coalescing coalescing;
+		QVector <int> levels;
+		for (;;) {
+			Event event = stream->pop();
+			if (event.kind == Event::Kind::End) {
+				ok = ok && event.ok;
+				break;
+			}
+			if (!ok)
+				continue;
+
+			switch (event.kind) {
+				case Event::Kind::Title:
+					streamedTitle = std::move(event.node);
+					titleNode = &streamedTitle;
+					break;
+				case Event::Kind::Enter: {
+					if (context.inParagraph())
+						out << context.pop();
+					int level;
+					out << context.push(event.node.value, &level);
+					levels.append(level);
+					break;
+				}
+				case Event::Kind::Subtree:
+					::coalesce(event.node, coalescing);
+					emitNode(event.node);
+					break;
+				case Event::Kind::Exit:
+					if (!levels.isEmpty())
+						out << context.pop(levels.takeLast());
+					break;
+				case Event::Kind::End:
+					break;
+			}
+		}
+		coalescing.report();
+	} else {
+		doOutput(documentRoot);
+	}
 
 	while (!context.empty())
-		output << context.pop();
+		out << context.pop();
+
+	Stats::add("emit.bytes", out.written());
+	Stats::add("emit.cache.hits", hits);
+	Stats::add("emit.cache.misses", misses);
+	Metrics::add(Metrics::Counter::CacheHits, hits);
+	Metrics::add(Metrics::Counter::CacheMisses, misses);
+	return ok;
 }
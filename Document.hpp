@@ -1,14 +1,29 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "AST.hpp"
+#include "EventQueue.hpp"
+#include "Formulas.hpp"
+#include "Images.hpp"
+
+class Sink;
 
 struct Document {
 	Document() = default;
 	Document(Node &&title, Node &&root) : title{std::move(title)}, documentRoot{std::move(root)} {}
-	Document(Document &&other) : title{std::move(other.title)}, documentRoot{std::move(other.documentRoot)} {}
+	Document(Document &&other) : title{std::move(other.title)}, documentRoot{std::move(other.documentRoot)}, images{std::move(other.images)}, formulas{std::move(other.formulas)}, stream{std::move(other.stream)} {}
 
-	void output() const;
+	void coalesce();
+	std::vector <Document> splitSections();
+	QByteArray fingerprint() const;
+	bool output(Sink &output) const;
+	QString titleText() const;
 
 	Node title;
 	Node documentRoot;
+	Images images;
+	Formulas formulas;
+	std::shared_ptr <EventQueue> stream; // when set, output() emits the events instead of documentRoot
 };
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "AST.hpp"
+
+/*
+ * What a streaming parser hands to the emitter. The document root is
+ * entered and exited, everything below it arrives as finished top-level
+ * subtrees, which are the smallest units the recursive-descent parsers can
+ * let go of. The title comes first so that \maketitle can be served.
+ */
+struct Event {
+	enum class Kind : quint8 {
+		Title,
+		Enter, // `node` without children
+		Subtree,
+		Exit,
+		End, // parsing is over, `ok` tells how it went
+	};
+
+	Kind kind = Kind::End;
+	Node node;
+	bool ok = true;
+};
+
+/*
+ * Bounded single-producer single-consumer ring buffer. Neither side takes
+ * a lock while the other keeps up; a full or an empty queue is spun on
+ * briefly and then slept out on a condition variable, which the other side
+ * only signals while someone sleeps.
+ */
+template <typename T, quint32 Capacity>
+class SpscQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "the indices wrap around, capacity must be a power of two");
+
+public:
+	void push(T &&value)
+	{
+		const quint32 tail = m_tail.load(std::memory_order_relaxed);
+		waitUntil([this, tail](){
+			return tail - m_head.load(std::memory_order_acquire) != Capacity;
+		});
+
+		m_items[tail % Capacity] = std::move(value);
+		m_tail.store(tail + 1, std::memory_order_release);
+		wake();
+	}
+
+	T pop()
+	{
+		const quint32 head = m_head.load(std::memory_order_relaxed);
+		waitUntil([this, head](){
+			return m_tail.load(std::memory_order_acquire) != head;
+		});
+
+		T result = std::move(m_items[head % Capacity]);
+		m_head.store(head + 1, std::memory_order_release);
+		wake();
+		return result;
+	}
+
+private:
+	static constexpr int Spins = 128;
+
+	/*
+	 * The fences here and in wake() order the sleeper's registration before
+	 * its last look at the queue, and the other side's update before its look
+	 * at the sleepers, so that at least one of the two sees the other.
+	 */
+	template <typename Ready>
+	void waitUntil(Ready ready)
+	{
+		for (int i = 0; i < Spins; ++i) {
+			if (ready())
+				return;
+		}
+
+		std::unique_lock <std::mutex> lock{m_mutex};
+		m_sleepers.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_wake.wait(lock, ready);
+		m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void wake()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_sleepers.load(std::memory_order_relaxed) == 0)
+			return;
+
+		std::lock_guard <std::mutex> lock{m_mutex};
+		m_wake.notify_one();
+	}
+
+	std::array <T, Capacity> m_items;
+	alignas(64) std::atomic <quint32> m_head{0};
+	alignas(64) std::atomic <quint32> m_tail{0};
+	alignas(64) std::atomic <int> m_sleepers{0};
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+};
+
+using EventQueue = SpscQueue <Event, 256>;
@@ -0,0 +1,71 @@
+#include "Formulas.hpp"
+#include "MathML.hpp"
+#include "Tasks.hpp"
+
+Formulas::Formulas(Formulas &&other)
+{
+	std::lock_guard <std::mutex> lock{other.m_mutex};
+	m_formulas = std::move(other.m_formulas);
+	m_index = std::move(other.m_index);
+}
+
+Formulas & Formulas::operator = (Formulas &&other)
+{
+	if (this == &other)
+		return *this;
+
+	std::scoped_lock lock{m_mutex, other.m_mutex};
+	m_formulas = std::move(other.m_formulas);
+	m_index = std::move(other.m_index);
+	return *this;
+}
+
+Formula Formulas::add(const QByteArray &tex, bool display, QThreadPool &pool)
+{
+	const QByteArray source = tex.simplified();
+	const QByteArray key = (display ? "D" : "I") + source;
+
+	std::lock_guard <std::mutex> lock{m_mutex};
+	auto iter = m_index.constFind(key);
+	if (iter != m_index.constEnd())
+		return m_formulas[*iter];
+
+	Formula formula;
+	formula.tex = source;
+	formula.display = display;
+	formula.href = QString{"Object %1"}.arg(m_formulas.count() + 1);
+	formula.mathml = runTask(pool, [source, display](){
+		return texToMathML(source, display);
+	}).share();
+
+	m_index.insert(key, m_formulas.count());
+	m_formulas.append(formula);
+	return formula;
+}
+
+Formula Formulas::adopt(const Formula &formula)
+{
+	const QByteArray key = (formula.display ? "D" : "I") + formula.tex;
+
+	std::lock_guard <std::mutex> lock{m_mutex};
+	auto iter = m_index.constFind(key);
+	if (iter != m_index.constEnd())
+		return m_formulas[*iter];
+
+	Formula result = formula;
+	result.href = QString{"Object %1"}.arg(m_formulas.count() + 1);
+	m_index.insert(key, m_formulas.count());
+	m_formulas.append(result);
+	return result;
+}
+
+void Formulas::insert(const Formula &formula)
+{
+	const QByteArray key = (formula.display ? "D" : "I") + formula.tex;
+
+	std::lock_guard <std::mutex> lock{m_mutex};
+	if (m_index.contains(key))
+		return;
+	m_index.insert(key, m_formulas.count());
+	m_formulas.append(formula);
+}
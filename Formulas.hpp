@@ -0,0 +1,35 @@
+#pragma once
+
+#include <future>
+#include <mutex>
+#include <QtCore>
+
+struct Formula {
+	QByteArray tex;
+	bool display = false;
+	QString href; // directory of the embedded object in the package
+	std::shared_future <QByteArray> mathml;
+};
+
+/*
+ * Formulas of a document, one embedded object per distinct formula however
+ * often it occurs. The MathML is generated on the pool passed to add(), the
+ * parser's own, while parsing goes on; add() may be called from several
+ * parser threads at once.
+ */
+class Formulas {
+public:
+	Formulas() = default;
+	Formulas(Formulas &&other);
+	Formulas & operator = (Formulas &&other);
+
+	Formula add(const QByteArray &tex, bool display, QThreadPool &pool);
+	Formula adopt(const Formula &formula); // of another collection, renamed into this one
+	void insert(const Formula &formula); // as it is, href included
+	const QVector <Formula> & all() const { return m_formulas; }
+
+private:
+	std::mutex m_mutex;
+	QVector <Formula> m_formulas;
+	QHash <QByteArray, int> m_index;
+};
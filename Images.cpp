@@ -0,0 +1,153 @@
+#include <cstring>
+
+#include "Depends.hpp"
+#include "Diagnostics.hpp"
+#include "Images.hpp"
+
+namespace {
+
+quint32 bigEndian(const uchar *data, int bytes)
+{
+	quint32 result = 0;
+	for (int i = 0; i < bytes; ++i)
+		result = (result << 8) | data[i];
+	return result;
+}
+
+bool pngSize(const uchar *data, qint64 size, Image &image)
+{
+	static const char Signature[] = "\x89PNG\r\n\x1a\n";
+	if (size < 24 || memcmp(data, Signature, 8) != 0 || memcmp(data + 12, "IHDR", 4) != 0)
+		return false;
+
+	image.width = bigEndian(data + 16, 4);
+	image.height = bigEndian(data + 20, 4);
+	return true;
+}
+
+bool jpegSize(const uchar *data, qint64 size, Image &image)
+{
+	if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+		return false;
+
+	qint64 idx = 2;
+	while (idx + 9 < size) {
+		if (data[idx] != 0xff)
+			return false;
+
+		const uchar marker = data[idx + 1];
+		const bool isFrame = marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+		if (isFrame) {
+			image.height = bigEndian(data + idx + 5, 2);
+			image.width = bigEndian(data + idx + 7, 2);
+			return true;
+		}
+
+		idx += 2 + bigEndian(data + idx + 2, 2);
+	}
+
+	return false;
+}
+
+}
+
+Images::Images(Images &&other)
+{
+	std::lock_guard <std::mutex> lock{other.m_mutex};
+	m_images = std::move(other.m_images);
+	m_index = std::move(other.m_index);
+}
+
+Images & Images::operator = (Images &&other)
+{
+	if (this == &other)
+		return *this;
+
+	std::scoped_lock lock{m_mutex, other.m_mutex};
+	m_images = std::move(other.m_images);
+	m_index = std::move(other.m_index);
+	return *this;
+}
+
+std::optional <Image> Images::add(const QString &filename)
+{
+	QFileInfo info{filename};
+	if (!info.exists() && info.suffix().isEmpty()) {
+		for (const char *suffix : {".png", ".jpg", ".jpeg"}) {
+			info.setFile(filename + suffix);
+			if (info.exists())
+				break;
+		}
+	}
+
+	const QString source = info.canonicalFilePath();
+	if (source.isEmpty()) {
+		Depends::recordAbsent(filename);
+		if (QFileInfo{filename}.suffix().isEmpty()) {
+			for (const char *suffix : {".png", ".jpg", ".jpeg"})
+				Depends::recordAbsent(filename + suffix);
+		}
+		Diagnostics::error(QString{"includegraphics: file not found: %1"}.arg(filename));
+		return {};
+	}
+
+	std::lock_guard <std::mutex> lock{m_mutex};
+	auto iter = m_index.constFind(source);
+	if (iter != m_index.constEnd())
+		return m_images[*iter];
+
+	QFile file{source};
+	if (!file.open(QIODevice::ReadOnly)) {
+		Diagnostics::error(QString{"includegraphics: unable to open: %1"}.arg(source));
+		return {};
+	}
+
+	const uchar *data = file.map(0, file.size());
+	if (data == nullptr) {
+		Diagnostics::error(QString{"includegraphics: unable to map: %1"}.arg(source));
+		return {};
+	}
+	Depends::record(source, QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size()));
+
+	Image image;
+	image.source = source;
+	QString suffix;
+	if (pngSize(data, file.size(), image)) {
+		image.mediaType = "image/png";
+		suffix = "png";
+	} else if (jpegSize(data, file.size(), image)) {
+		image.mediaType = "image/jpeg";
+		suffix = "jpg";
+	} else {
+		Diagnostics::error(QString{"includegraphics: only PNG and JPEG images are supported: %1"}.arg(source));
+		return {};
+	}
+
+	image.href = QString{"Pictures/image%1.%2"}.arg(m_images.count() + 1).arg(suffix);
+	m_index.insert(source, m_images.count());
+	m_images.append(image);
+	return image;
+}
+
+Image Images::adopt(const Image &image)
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	auto iter = m_index.constFind(image.source);
+	if (iter != m_index.constEnd())
+		return m_images[*iter];
+
+	Image result = image;
+	result.href = QString{"Pictures/image%1.%2"}.arg(m_images.count() + 1).arg(QFileInfo{image.href}.suffix());
+	m_index.insert(result.source, m_images.count());
+	m_images.append(result);
+	return result;
+}
+
+void Images::insert(const Image &image)
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	if (m_index.contains(image.source))
+		return;
+	m_index.insert(image.source, m_images.count());
+	m_images.append(image);
+}
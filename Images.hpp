@@ -0,0 +1,35 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <QtCore>
+
+struct Image {
+	QString source;
+	QString href;
+	QString mediaType;
+	int width = 0;
+	int height = 0;
+};
+
+/*
+ * Images referenced by a document, keyed by canonical path, so that every
+ * file ends up in the package once however often it is included. add() may
+ * be called from several parser threads at once.
+ */
+class Images {
+public:
+	Images() = default;
+	Images(Images &&other);
+	Images & operator = (Images &&other);
+
+	std::optional <Image> add(const QString &filename);
+	Image adopt(const Image &image); // of another collection, renamed into this one
+	void insert(const Image &image); // as it is, href included
+	const QVector <Image> & all() const { return m_images; }
+
+private:
+	std::mutex m_mutex;
+	QVector <Image> m_images;
+	QHash <QString, int> m_index;
+};
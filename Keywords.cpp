@@ -0,0 +1,22 @@
+#include "Keywords.hpp"
+
+namespace Keywords {
+
+Match find(const QByteArray &name)
+{
+	quint32 h = Slots.seed;
+	for (const char c : name)
+		h = hashStep(h, static_cast<uchar>(c));
+
+	const int idx = Slots.slots[slotOf(h)] - 1;
+	if (idx == NotFound || name != Table[idx].name)
+		return Match{};
+	return Match{idx, Table[idx].flags};
+}
+
+QByteArray name(int id)
+{
+	return QByteArray::fromRawData(Table[id].name, qstrlen(Table[id].name));
+}
+
+} // Keywords
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <QtCore>
+
+#include "Markup/Cpp.hpp"
+#include "Markup/Highlight.hpp"
+#include "Strings.hpp"
+
+/*
+ * Every control word known to the converter, together with the categories
+ * it belongs to. The table is hashed at compile time with a seed chosen so
+ * that no two names share a slot, hence a lookup is a single probe followed
+ * by one string comparison.
+ */
+namespace Keywords {
+
+enum Category : quint8 {
+	Environment = 1 << 0,
+	Fragment = 1 << 1,
+	Tag = 1 << 2,
+	Block = 1 << 3,
+	List = 1 << 4,
+	Ignored = 1 << 5,
+	Markup = 1 << 6,
+};
+
+struct Keyword {
+	const char *name;
+	quint8 flags;
+};
+
+constexpr Keyword Table[] = {
+	{Strings::Document, Environment},
+	{Strings::Enumerate, Environment | List},
+	{Strings::Itemize, Environment | List},
+	{Strings::Verbatim, Environment},
+	{"center", Environment},
+
+	{Strings::BoldFace, Fragment},
+	{Strings::Hspace, Fragment},
+	{Strings::Include, Fragment},
+	{Strings::Input, Fragment},
+	{Strings::Italic, Fragment},
+	{Strings::Section, Fragment | Block},
+	{Strings::SourceCode, Fragment | Ignored},
+	{Strings::Subsection, Fragment | Block},
+	{Strings::TextTT, Fragment},
+	{Strings::Title, Fragment | Block},
+	{"hspace*", Fragment},
+	{"mbox", Fragment},
+	{"textsf", Fragment},
+
+	{Highlight::CommentBlock, Fragment},
+	{Highlight::CommentCpp, Fragment},
+	{Highlight::Escape, Fragment},
+	{Highlight::KeywordA, Fragment},
+	{Highlight::KeywordB, Fragment},
+	{Highlight::KeywordC, Fragment},
+	{Highlight::IncludeQuote, Fragment},
+	{Highlight::LineNumbering, Fragment},
+	{Highlight::NumberConstant, Fragment},
+	{Highlight::Operator, Fragment},
+	{Highlight::Preprocessor, Fragment},
+	{Highlight::Standard, Fragment},
+	{Highlight::String, Fragment},
+	{Highlight::StringSubstitution, Fragment},
+	{Highlight::Type, Fragment},
+
+	{Strings::Backslash, Tag},
+	{Strings::CodeTilde, Tag},
+	{Strings::Item, Tag},
+	{Strings::Ldots, Tag},
+	{Strings::MakeTitle, Tag},
+	{Strings::NormalFont, Tag},
+	{Strings::Quote, Tag},
+	{Strings::Textbar, Tag},
+	{Strings::TextBackslash, Tag},
+	{Strings::Tilde, Tag},
+	{Strings::TTFamily, Tag},
+	{Strings::Underscore, Tag},
+	{"fill", Tag},
+	{"indent", Tag},
+	{"noindent", Tag},
+	{"normalsize", Tag},
+
+	{Strings::CodeLine, Block},
+	{Strings::Paragraph, Block},
+
+	{Cpp::AddAssign, Markup},
+	{Cpp::And, Markup},
+	{Cpp::Cpp, Markup},
+	{Cpp::Decrement, Markup},
+	{Cpp::Equal, Markup},
+	{Cpp::GreaterEqual, Markup},
+	{Cpp::Increment, Markup},
+	{Cpp::LeftShift, Markup},
+	{Cpp::LessEqual, Markup},
+	{Cpp::MinusAssign, Markup},
+	{Cpp::NotEqual, Markup},
+	{Cpp::Or, Markup},
+	{Cpp::PtrAccess, Markup},
+	{Cpp::RightShift, Markup},
+	{Cpp::Scope, Markup},
+};
+
+constexpr int Count = sizeof(Table) / sizeof(Table[0]);
+constexpr int NotFound = -1;
+constexpr int HashBits = 10;
+constexpr int SlotCount = 1 << HashBits;
+
+static_assert(Count < 0xff, "slot indices are stored in a quint8");
+
+constexpr quint32 hashStep(quint32 h, quint16 c)
+{
+	return (h ^ c) * 16777619u;
+}
+
+constexpr int slotOf(quint32 h)
+{
+	return (h * 2654435769u) >> (32 - HashBits);
+}
+
+constexpr quint32 hash(const char *name, quint32 seed)
+{
+	quint32 h = seed;
+	while (*name != '\0')
+		h = hashStep(h, static_cast<uchar>(*name++));
+	return h;
+}
+
+struct SlotTable {
+	quint32 seed;
+	quint8 slots[SlotCount]; // index into Table + 1, 0 for an empty slot
+};
+
+constexpr SlotTable buildSlotTable()
+{
+	for (quint32 seed = 2166136261u; ; ++seed) {
+		SlotTable result{};
+		bool collision = false;
+		for (int i = 0; i < Count && !collision; ++i) {
+			quint8 &slot = result.slots[slotOf(hash(Table[i].name, seed))];
+			collision = (slot != 0);
+			slot = i + 1;
+		}
+
+		if (!collision) {
+			result.seed = seed;
+			return result;
+		}
+	}
+}
+
+constexpr SlotTable Slots = buildSlotTable();
+
+constexpr bool equal(const char *a, const char *b)
+{
+	while (*a != '\0' && *a == *b) {
+		++a;
+		++b;
+	}
+	return *a == *b;
+}
+
+constexpr int id(const char *name)
+{
+	const int idx = Slots.slots[slotOf(hash(name, Slots.seed))] - 1;
+	if (idx == NotFound || !equal(Table[idx].name, name))
+		return NotFound;
+	return idx;
+}
+
+struct Match {
+	int id = NotFound;
+	quint8 flags = 0;
+};
+
+Match find(const QByteArray &name);
+
+/* The name of a keyword as a byte array over the static table, without a copy. */
+QByteArray name(int id);
+
+} // Keywords
@@ -1,99 +1,83 @@
+#include "Keywords.hpp"
 #include "Markup/Cpp.hpp"
 #include "Strings.hpp"
 #include "XmlGen.hpp"
 
 namespace Cpp {
 
-const QString AddAssign = "cppAddAssign";
-const QString And = "cppAnd";
-const QString Cpp = "cpp";
-const QString Decrement = "cppDec";
-const QString Equal = "cppEqual";
-const QString GreaterEqual = "cppGreaterEqual";
-const QString Increment = "cppInc";
-const QString LeftShift = "cppLeftShift";
-const QString LessEqual = "cppLessEqual";
-const QString MinusAssign = "cppMinusAssign";
-const QString NotEqual = "cppNotEqual";
-const QString Or = "cppOr";
-const QString PtrAccess = "cppPtrAccess";
-const QString RightShift = "cppRightShift";
-const QString Scope = "cppScope";
-
-const QString & markup(const QString &tag)
+const QByteArray & markup(int id)
 {
-	static const QString Empty{};
-	static const QMap <QString, QString> Markup = [](){
-		QMap <QString, QString> result;
+	static const QByteArray Empty{};
+	static const QVector <QByteArray> Markup = [](){
+		QVector <QByteArray> result(Keywords::Count);
 
-		result[AddAssign] = entryText(Strings::TextTT)
+		result[Keywords::id(AddAssign)] = QByteArray{entryText(Strings::TextTT)}
 			+ '+' + Unicode::NoSpaceDontBreak + '='
 			+ exitText(Strings::TextTT);
 
-		result[And] = entryText(Strings::TextTT)
+		result[Keywords::id(And)] = QByteArray{entryText(Strings::TextTT)}
 			+ "&amp;" + Unicode::NoSpaceDontBreak + "&amp;"
 			+ exitText(Strings::TextTT);
 
-		result[Cpp] = entryText(Strings::BoldFace) + 'C' + exitText(Strings::BoldFace)
-			+ entryText(Strings::TextTT) +
+		result[Keywords::id(Cpp)] = QByteArray{entryText(Strings::BoldFace)} + 'C' + exitText(Strings::BoldFace)
+			+ entryText(Strings::TextTT)
 			+ '+' + Unicode::NoSpaceDontBreak + '+'
 			+ exitText(Strings::TextTT);
 
-		result[Decrement] = entryText(Strings::TextTT)
+		result[Keywords::id(Decrement)] = QByteArray{entryText(Strings::TextTT)}
 			+ '-' + Unicode::NoSpaceDontBreak + '-'
 			+ exitText(Strings::TextTT);
 
-		result[Equal] = entryText(Strings::TextTT)
+		result[Keywords::id(Equal)] = QByteArray{entryText(Strings::TextTT)}
 			+ '=' + Unicode::NoSpaceDontBreak + '='
 			+ exitText(Strings::TextTT);
 
-		result[GreaterEqual] = entryText(Strings::TextTT)
+		result[Keywords::id(GreaterEqual)] = QByteArray{entryText(Strings::TextTT)}
 			+ "&gt;" + Unicode::NoSpaceDontBreak + '='
 			+ exitText(Strings::TextTT);
 
-		result[Increment] = entryText(Strings::TextTT)
+		result[Keywords::id(Increment)] = QByteArray{entryText(Strings::TextTT)}
 			+ '+' + Unicode::NoSpaceDontBreak + '+'
 			+ exitText(Strings::TextTT);
 
-		result[LeftShift] = entryText(Strings::TextTT)
+		result[Keywords::id(LeftShift)] = QByteArray{entryText(Strings::TextTT)}
 			+ "&lt;" + Unicode::NoSpaceDontBreak + "&lt;"
 			+ exitText(Strings::TextTT);
 
-		result[LessEqual] = entryText(Strings::TextTT)
+		result[Keywords::id(LessEqual)] = QByteArray{entryText(Strings::TextTT)}
 			+ "&lt;" + Unicode::NoSpaceDontBreak + '='
 			+ exitText(Strings::TextTT);
 
-		result[MinusAssign] = entryText(Strings::TextTT)
+		result[Keywords::id(MinusAssign)] = QByteArray{entryText(Strings::TextTT)}
 			+ '-' + Unicode::NoSpaceDontBreak + '='
 			+ exitText(Strings::TextTT);
 
-		result[NotEqual] = entryText(Strings::TextTT)
+		result[Keywords::id(NotEqual)] = QByteArray{entryText(Strings::TextTT)}
 			+ '!' + Unicode::NoSpaceDontBreak + '='
 			+ exitText(Strings::TextTT);
 
-		result[Or] = entryText(Strings::TextTT)
+		result[Keywords::id(Or)] = QByteArray{entryText(Strings::TextTT)}
 			+ '|' + Unicode::NoSpaceDontBreak + '|'
 			+ exitText(Strings::TextTT);
 
-		result[PtrAccess] = entryText(Strings::TextTT)
+		result[Keywords::id(PtrAccess)] = QByteArray{entryText(Strings::TextTT)}
 			+ '-' + Unicode::NoSpaceDontBreak + "&gt;"
 			+ exitText(Strings::TextTT);
 
-		result[RightShift] = entryText(Strings::TextTT)
+		result[Keywords::id(RightShift)] = QByteArray{entryText(Strings::TextTT)}
 			+ "&gt;" + Unicode::NoSpaceDontBreak + "&gt;"
 			+ exitText(Strings::TextTT);
 
-		result[Scope] = entryText(Strings::TextTT)
+		result[Keywords::id(Scope)] = QByteArray{entryText(Strings::TextTT)}
 			+ ':' + Unicode::NoSpaceDontBreak + ':'
 			+ exitText(Strings::TextTT);
 
 		return result;
 	}();
 
-	auto iter = Markup.find(tag);
-	if (iter == Markup.end())
+	if (id < 0 || id >= Markup.count())
 		return Empty;
-	return *iter;
+	return Markup[id];
 }
 
 } // Cpp
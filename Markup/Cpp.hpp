@@ -4,6 +4,22 @@
 
 namespace Cpp {
 
-const QString & markup(const QString &tag);
+constexpr const char *AddAssign = "cppAddAssign";
+constexpr const char *And = "cppAnd";
+constexpr const char *Cpp = "cpp";
+constexpr const char *Decrement = "cppDec";
+constexpr const char *Equal = "cppEqual";
+constexpr const char *GreaterEqual = "cppGreaterEqual";
+constexpr const char *Increment = "cppInc";
+constexpr const char *LeftShift = "cppLeftShift";
+constexpr const char *LessEqual = "cppLessEqual";
+constexpr const char *MinusAssign = "cppMinusAssign";
+constexpr const char *NotEqual = "cppNotEqual";
+constexpr const char *Or = "cppOr";
+constexpr const char *PtrAccess = "cppPtrAccess";
+constexpr const char *RightShift = "cppRightShift";
+constexpr const char *Scope = "cppScope";
+
+const QByteArray & markup(int id);
 
 } // Cpp
@@ -1,23 +1,21 @@
 #pragma once
 
-#include <QtCore>
-
 namespace Highlight {
 
-const QString CommentBlock = "hlcom";
-const QString CommentCpp = "hlslc";
-const QString Escape = "hlesc";
-const QString KeywordA = "hlkwa";
-const QString KeywordB = "hlkwb";
-const QString KeywordC = "hlkwc";
-const QString IncludeQuote = "hlpps";
-const QString LineNumbering = "hllin";
-const QString NumberConstant = "hlnum";
-const QString Operator = "hlopt";
-const QString Preprocessor = "hlppc";
-const QString Standard = "hlstd";
-const QString String = "hlstr";
-const QString StringSubstitution = "hlipl";
-const QString Type = "hlkwd";
+constexpr const char *CommentBlock = "hlcom";
+constexpr const char *CommentCpp = "hlslc";
+constexpr const char *Escape = "hlesc";
+constexpr const char *KeywordA = "hlkwa";
+constexpr const char *KeywordB = "hlkwb";
+constexpr const char *KeywordC = "hlkwc";
+constexpr const char *IncludeQuote = "hlpps";
+constexpr const char *LineNumbering = "hllin";
+constexpr const char *NumberConstant = "hlnum";
+constexpr const char *Operator = "hlopt";
+constexpr const char *Preprocessor = "hlppc";
+constexpr const char *Standard = "hlstd";
+constexpr const char *String = "hlstr";
+constexpr const char *StringSubstitution = "hlipl";
+constexpr const char *Type = "hlkwd";
 
 } // Highlight
@@ -0,0 +1,282 @@
+#include "Fold.hpp"
+#include "MathML.hpp"
+
+namespace {
+
+struct Symbol {
+	const char *text;
+	const char *element;
+};
+
+const QHash <QByteArray, Symbol> Symbols {
+	{"alpha", {"α", "mi"}}, {"beta", {"β", "mi"}}, {"gamma", {"γ", "mi"}}, {"delta", {"δ", "mi"}},
+	{"epsilon", {"ϵ", "mi"}}, {"varepsilon", {"ε", "mi"}}, {"zeta", {"ζ", "mi"}}, {"eta", {"η", "mi"}},
+	{"theta", {"θ", "mi"}}, {"vartheta", {"ϑ", "mi"}}, {"iota", {"ι", "mi"}}, {"kappa", {"κ", "mi"}},
+	{"lambda", {"λ", "mi"}}, {"mu", {"μ", "mi"}}, {"nu", {"ν", "mi"}}, {"xi", {"ξ", "mi"}},
+	{"pi", {"π", "mi"}}, {"rho", {"ρ", "mi"}}, {"sigma", {"σ", "mi"}}, {"tau", {"τ", "mi"}},
+	{"upsilon", {"υ", "mi"}}, {"phi", {"ϕ", "mi"}}, {"varphi", {"φ", "mi"}}, {"chi", {"χ", "mi"}},
+	{"psi", {"ψ", "mi"}}, {"omega", {"ω", "mi"}},
+	{"Gamma", {"Γ", "mi"}}, {"Delta", {"Δ", "mi"}}, {"Theta", {"Θ", "mi"}}, {"Lambda", {"Λ", "mi"}},
+	{"Xi", {"Ξ", "mi"}}, {"Pi", {"Π", "mi"}}, {"Sigma", {"Σ", "mi"}}, {"Phi", {"Φ", "mi"}},
+	{"Psi", {"Ψ", "mi"}}, {"Omega", {"Ω", "mi"}},
+	{"infty", {"∞", "mi"}}, {"partial", {"∂", "mi"}}, {"nabla", {"∇", "mi"}}, {"emptyset", {"∅", "mi"}},
+	{"ell", {"ℓ", "mi"}}, {"hbar", {"ℏ", "mi"}},
+
+	{"cdot", {"⋅", "mo"}}, {"times", {"×", "mo"}}, {"div", {"÷", "mo"}}, {"pm", {"±", "mo"}},
+	{"mp", {"∓", "mo"}}, {"ast", {"∗", "mo"}}, {"circ", {"∘", "mo"}},
+	{"leq", {"≤", "mo"}}, {"le", {"≤", "mo"}}, {"geq", {"≥", "mo"}}, {"ge", {"≥", "mo"}},
+	{"neq", {"≠", "mo"}}, {"ne", {"≠", "mo"}}, {"approx", {"≈", "mo"}}, {"equiv", {"≡", "mo"}},
+	{"sim", {"∼", "mo"}}, {"simeq", {"≃", "mo"}}, {"propto", {"∝", "mo"}}, {"ll", {"≪", "mo"}},
+	{"gg", {"≫", "mo"}},
+	{"in", {"∈", "mo"}}, {"notin", {"∉", "mo"}}, {"subset", {"⊂", "mo"}}, {"subseteq", {"⊆", "mo"}},
+	{"supset", {"⊃", "mo"}}, {"supseteq", {"⊇", "mo"}}, {"cup", {"∪", "mo"}}, {"cap", {"∩", "mo"}},
+	{"setminus", {"∖", "mo"}}, {"forall", {"∀", "mo"}}, {"exists", {"∃", "mo"}}, {"neg", {"¬", "mo"}},
+	{"land", {"∧", "mo"}}, {"wedge", {"∧", "mo"}}, {"lor", {"∨", "mo"}}, {"vee", {"∨", "mo"}},
+	{"to", {"→", "mo"}}, {"rightarrow", {"→", "mo"}}, {"leftarrow", {"←", "mo"}},
+	{"Rightarrow", {"⇒", "mo"}}, {"Leftarrow", {"⇐", "mo"}}, {"leftrightarrow", {"↔", "mo"}},
+	{"Leftrightarrow", {"⇔", "mo"}}, {"iff", {"⇔", "mo"}}, {"implies", {"⇒", "mo"}}, {"mapsto", {"↦", "mo"}},
+	{"ldots", {"…", "mo"}}, {"dots", {"…", "mo"}}, {"cdots", {"⋯", "mo"}}, {"vdots", {"⋮", "mo"}},
+	{"sum", {"∑", "mo"}}, {"prod", {"∏", "mo"}}, {"int", {"∫", "mo"}}, {"iint", {"∬", "mo"}},
+	{"oint", {"∮", "mo"}}, {"langle", {"⟨", "mo"}}, {"rangle", {"⟩", "mo"}}, {"lfloor", {"⌊", "mo"}},
+	{"rfloor", {"⌋", "mo"}}, {"lceil", {"⌈", "mo"}}, {"rceil", {"⌉", "mo"}}, {"mid", {"∣", "mo"}},
+
+	{"sin", {"sin", "mi"}}, {"cos", {"cos", "mi"}}, {"tan", {"tan", "mi"}}, {"cot", {"cot", "mi"}},
+	{"arcsin", {"arcsin", "mi"}}, {"arccos", {"arccos", "mi"}}, {"arctan", {"arctan", "mi"}},
+	{"sinh", {"sinh", "mi"}}, {"cosh", {"cosh", "mi"}}, {"tanh", {"tanh", "mi"}},
+	{"log", {"log", "mi"}}, {"ln", {"ln", "mi"}}, {"exp", {"exp", "mi"}}, {"lim", {"lim", "mi"}},
+	{"max", {"max", "mi"}}, {"min", {"min", "mi"}}, {"sup", {"sup", "mi"}}, {"inf", {"inf", "mi"}},
+	{"det", {"det", "mi"}}, {"gcd", {"gcd", "mi"}}, {"deg", {"deg", "mi"}}, {"dim", {"dim", "mi"}},
+};
+
+const QHash <QByteArray, const char *> Spaces {
+	{",", "0.167em"}, {":", "0.222em"}, {";", "0.278em"}, {" ", "0.25em"},
+	{"quad", "1em"}, {"qquad", "2em"},
+};
+
+QByteArray escaped(QByteArray text)
+{
+	text.replace('&', "&amp;");
+	text.replace('<', "&lt;");
+	text.replace('>', "&gt;");
+	return text;
+}
+
+QByteArray element(const char *name, const QByteArray &content)
+{
+	return '<' + QByteArray{name} + '>' + content + "</" + name + '>';
+}
+
+bool isLetter(char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/*
+ * Recursive descent over the formula: a row is a sequence of atoms, each
+ * optionally followed by a subscript and a superscript.
+ */
+class MathParser {
+public:
+	explicit MathParser(const QByteArray &tex) : m_tex{tex} {}
+
+	QByteArray row(char end = '\0')
+	{
+		QByteArray result;
+		int count = 0;
+		while (true) {
+			skipSpaces();
+			if (eof() || (end != '\0' && current() == end))
+				break;
+			if (current() == '}') {
+				++m_idx;
+				continue;
+			}
+
+			const QByteArray item = atom();
+			if (item.isEmpty())
+				continue;
+			result += scripts(item);
+			++count;
+		}
+
+		if (count == 1)
+			return result;
+		return element("mrow", result);
+	}
+
+private:
+	bool eof() const { return m_idx >= m_tex.size(); }
+	char current() const { return m_tex[m_idx]; }
+
+	void skipSpaces()
+	{
+		while (!eof() && any_of(current(), ' ', '\t', '\n', '\r'))
+			++m_idx;
+	}
+
+	QByteArray atom()
+	{
+		const char c = current();
+		if (c == '{') {
+			++m_idx;
+			const QByteArray group = row('}');
+			if (!eof())
+				++m_idx;
+			return group;
+		}
+		if (c == '\\')
+			return command();
+		if (c == '^' || c == '_')
+			return "<mrow/>";
+		if (c == '&') {
+			++m_idx;
+			return QByteArray{};
+		}
+
+		const int start = m_idx++;
+		if (isDigit(c) || (c == '.' && !eof() && isDigit(current()))) {
+			while (!eof() && (isDigit(current()) || current() == '.'))
+				++m_idx;
+			return element("mn", m_tex.mid(start, m_idx - start));
+		}
+		if (isLetter(c))
+			return element("mi", QByteArray(1, c));
+		if (static_cast<uchar>(c) >= 0x80) {
+			while (!eof() && (static_cast<uchar>(current()) & 0xc0) == 0x80)
+				++m_idx;
+			return element("mi", m_tex.mid(start, m_idx - start));
+		}
+		if (c == '\'')
+			return element("mo", "′");
+
+		return element("mo", escaped(QByteArray(1, c)));
+	}
+
+	QByteArray argument()
+	{
+		skipSpaces();
+		if (eof())
+			return "<mrow/>";
+
+		const QByteArray result = atom();
+		return result.isEmpty() ? QByteArray{"<mrow/>"} : result;
+	}
+
+	QByteArray scripts(const QByteArray &base)
+	{
+		QByteArray sub, sup;
+		while (true) {
+			skipSpaces();
+			if (eof())
+				break;
+			if (current() == '_' && sub.isEmpty()) {
+				++m_idx;
+				sub = argument();
+			} else if (current() == '^' && sup.isEmpty()) {
+				++m_idx;
+				sup = argument();
+			} else {
+				break;
+			}
+		}
+
+		if (!sub.isEmpty() && !sup.isEmpty())
+			return element("msubsup", base + sub + sup);
+		if (!sub.isEmpty())
+			return element("msub", base + sub);
+		if (!sup.isEmpty())
+			return element("msup", base + sup);
+		return base;
+	}
+
+	QByteArray rawGroup()
+	{
+		skipSpaces();
+		if (eof() || current() != '{')
+			return QByteArray{};
+
+		const int start = ++m_idx;
+		int depth = 1;
+		for (; !eof(); ++m_idx) {
+			if (current() == '{')
+				++depth;
+			else if (current() == '}' && --depth == 0)
+				break;
+		}
+
+		const QByteArray result = m_tex.mid(start, m_idx - start);
+		if (!eof())
+			++m_idx;
+		return result;
+	}
+
+	QByteArray command()
+	{
+		const int start = ++m_idx;
+		while (!eof() && isLetter(current()))
+			++m_idx;
+		if (m_idx == start && !eof())
+			++m_idx;
+		const QByteArray name = m_tex.mid(start, m_idx - start);
+
+		if (Spaces.contains(name))
+			return "<mspace width=\"" + QByteArray{Spaces.value(name)} + "\"/>";
+
+		auto symbol = Symbols.constFind(name);
+		if (symbol != Symbols.constEnd())
+			return element(symbol->element, symbol->text);
+
+		if (any_of(name, "frac", "dfrac", "tfrac")) {
+			const QByteArray numerator = argument();
+			return element("mfrac", numerator + argument());
+		}
+		if (name == "sqrt") {
+			skipSpaces();
+			if (!eof() && current() == '[') {
+				++m_idx;
+				const QByteArray index = row(']');
+				if (!eof())
+					++m_idx;
+				return element("mroot", argument() + index);
+			}
+			return element("msqrt", argument());
+		}
+		if (any_of(name, "text", "textrm", "mbox"))
+			return element("mtext", escaped(rawGroup()));
+		if (any_of(name, "mathrm", "operatorname"))
+			return "<mi mathvariant=\"normal\">" + escaped(rawGroup()) + "</mi>";
+		if (any_of(name, "mathbf", "mathit", "mathbb", "mathcal", "boldsymbol"))
+			return argument();
+		if (any_of(name, "left", "right", "big", "Big", "bigg", "Bigg", "bigl", "bigr", "Bigl", "Bigr")) {
+			skipSpaces();
+			if (!eof() && current() == '.')
+				++m_idx;
+			return QByteArray{};
+		}
+		if (any_of(name, "{", "}", "|", "%", "$", "#"))
+			return element("mo", name);
+		if (any_of(name, "!", "\\", "displaystyle", "limits", "nolimits"))
+			return QByteArray{};
+
+		return element("merror", element("mtext", escaped('\\' + name)));
+	}
+
+	QByteArray m_tex;
+	int m_idx = 0;
+};
+
+}
+
+QByteArray texToMathML(const QByteArray &tex, bool display)
+{
+	MathParser parser{tex};
+	return "<math xmlns=\"http://www.w3.org/1998/Math/MathML\" display=\"" + QByteArray{display ? "block" : "inline"} + "\">"
+		"<semantics>" + parser.row()
+		+ "<annotation encoding=\"application/x-tex\">" + escaped(tex) + "</annotation>"
+		"</semantics></math>";
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <QtCore>
+
+/*
+ * Converts the TeX source of a formula, without its $ delimiters, into a
+ * MathML <math> element. Covers the common subset: letters, numbers and
+ * operators, sub- and superscripts, groups, \frac, \sqrt, text, Greek
+ * letters and the usual symbols. Unknown commands become <merror>.
+ */
+QByteArray texToMathML(const QByteArray &tex, bool display);
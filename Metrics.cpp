@@ -0,0 +1,274 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Metrics.hpp"
+
+namespace Metrics {
+
+namespace {
+
+constexpr int CounterCount = static_cast<int>(Counter::Count);
+constexpr int PhaseCount = static_cast<int>(Phase::Count);
+constexpr int FailureCount = static_cast<int>(Failure::Count);
+
+// upper bounds in seconds; the last bucket is +Inf
+constexpr double Buckets[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+constexpr int BucketCount = sizeof(Buckets) / sizeof(Buckets[0]) + 1;
+
+const char *CounterNames[CounterCount][2] = {
+	{"odtgen_documents_total", "Documents converted, successfully or not."},
+	{"odtgen_input_bytes_total", "Bytes of input converted."},
+	{"odtgen_output_bytes_total", "Bytes of output written."},
+	{"odtgen_emit_cache_hits_total", "Repeated subtrees copied from the emit cache."},
+	{"odtgen_emit_cache_misses_total", "Repeated subtrees emitted from scratch."},
+};
+const char *PhaseNames[PhaseCount] = {"parse", "emit", "highlight", "package"};
+const char *FailureNames[FailureCount] = {"usage", "parse", "budget", "output"};
+
+/*
+ * Only the owning thread writes, hence a relaxed load and store instead of
+ * a locked read-modify-write; scrapes read concurrently.
+ */
+struct Value {
+	void add(quint64 v)
+	{
+		value.store(value.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+	}
+
+	quint64 get() const
+	{
+		return value.load(std::memory_order_relaxed);
+	}
+
+	std::atomic <quint64> value{0};
+};
+
+struct Histogram {
+	Value buckets[BucketCount];
+	Value count;
+	Value sum; // nanoseconds
+};
+
+struct Slab {
+	Value counters[CounterCount];
+	Value failures[FailureCount];
+	Histogram phases[PhaseCount];
+};
+
+struct Totals {
+	quint64 counters[CounterCount] = {};
+	quint64 failures[FailureCount] = {};
+	struct {
+		quint64 buckets[BucketCount] = {};
+		quint64 count = 0;
+		quint64 sum = 0;
+	} phases[PhaseCount];
+
+	void add(const Slab &slab)
+	{
+		for (int i = 0; i < CounterCount; ++i)
+			counters[i] += slab.counters[i].get();
+		for (int i = 0; i < FailureCount; ++i)
+			failures[i] += slab.failures[i].get();
+		for (int i = 0; i < PhaseCount; ++i) {
+			for (int b = 0; b < BucketCount; ++b)
+				phases[i].buckets[b] += slab.phases[i].buckets[b].get();
+			phases[i].count += slab.phases[i].count.get();
+			phases[i].sum += slab.phases[i].sum.get();
+		}
+	}
+};
+
+std::mutex registryMutex;
+QVector <const Slab *> live;
+Totals retired; // of threads that have exited
+
+/*
+ * Registers the slab of a thread when the thread first records something
+ * and folds it into `retired` when the thread ends.
+ */
+struct Registration {
+	Registration()
+	{
+		std::lock_guard <std::mutex> lock{registryMutex};
+		live.append(&slab);
+	}
+
+	~Registration()
+	{
+		std::lock_guard <std::mutex> lock{registryMutex};
+		retired.add(slab);
+		live.removeOne(&slab);
+	}
+
+	Slab slab;
+};
+
+Slab & local()
+{
+	thread_local Registration registration;
+	return registration.slab;
+}
+
+thread_local qint64 nested = 0; // time of the timers nested in the current one
+
+void serveClient(int fd)
+{
+	char request[1024];
+	while (::read(fd, request, sizeof(request)) == -1 && errno == EINTR)
+		;
+
+	const QByteArray body = exposition();
+	QByteArray response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: ";
+	response += QByteArray::number(body.size()) + "\r\n\r\n" + body;
+
+	const char *data = response.constData();
+	qint64 size = response.size();
+	while (size > 0) {
+		const ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL); // a client gone must not kill the worker
+		if (written == -1 && errno == EINTR)
+			continue;
+		if (written <= 0)
+			break;
+		data += written;
+		size -= written;
+	}
+	::close(fd);
+}
+
+}
+
+void add(Counter counter, qint64 value)
+{
+	local().counters[static_cast<int>(counter)].add(value);
+}
+
+void fail(Failure failure)
+{
+	local().failures[static_cast<int>(failure)].add(1);
+}
+
+void observe(Phase phase, qint64 nanoseconds)
+{
+	Histogram &histogram = local().phases[static_cast<int>(phase)];
+	const double seconds = nanoseconds / 1e9;
+	int bucket = 0;
+	while (bucket < BucketCount - 1 && seconds > Buckets[bucket])
+		++bucket;
+	histogram.buckets[bucket].add(1);
+	histogram.count.add(1);
+	histogram.sum.add(nanoseconds);
+}
+
+PhaseTimer::PhaseTimer(Phase phase) : m_phase{phase}, m_outerNested{nested}
+{
+	nested = 0;
+	m_timer.start();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+	const qint64 elapsed = m_timer.nsecsElapsed();
+	observe(m_phase, elapsed - nested);
+	nested = m_outerNested + elapsed;
+}
+
+QByteArray exposition()
+{
+	Totals totals;
+	{
+		std::lock_guard <std::mutex> lock{registryMutex};
+		totals = retired;
+		for (const Slab *slab : live)
+			totals.add(*slab);
+	}
+
+	QByteArray result;
+	for (int i = 0; i < CounterCount; ++i) {
+		result += QByteArray{"# HELP "} + CounterNames[i][0] + ' ' + CounterNames[i][1] + '\n';
+		result += QByteArray{"# TYPE "} + CounterNames[i][0] + " counter\n";
+		result += QByteArray{CounterNames[i][0]} + ' ' + QByteArray::number(totals.counters[i]) + '\n';
+	}
+
+	result += "# HELP odtgen_failures_total Failed conversions by kind.\n";
+	result += "# TYPE odtgen_failures_total counter\n";
+	for (int i = 0; i < FailureCount; ++i)
+		result += QByteArray{"odtgen_failures_total{kind=\""} + FailureNames[i] + "\"} " + QByteArray::number(totals.failures[i]) + '\n';
+
+	result += "# HELP odtgen_phase_seconds Time spent per phase of a conversion.\n";
+	result += "# TYPE odtgen_phase_seconds histogram\n";
+	for (int i = 0; i < PhaseCount; ++i) {
+		const QByteArray phase = QByteArray{"phase=\""} + PhaseNames[i] + '"';
+		quint64 cumulative = 0;
+		for (int b = 0; b < BucketCount; ++b) {
+			cumulative += totals.phases[i].buckets[b];
+			const QByteArray le = (b == BucketCount - 1) ? QByteArray{"+Inf"} : QByteArray::number(Buckets[b]);
+			result += "odtgen_phase_seconds_bucket{" + phase + ",le=\"" + le + "\"} " + QByteArray::number(cumulative) + '\n';
+		}
+		result += "odtgen_phase_seconds_sum{" + phase + "} " + QByteArray::number(totals.phases[i].sum / 1e9, 'f', 6) + '\n';
+		result += "odtgen_phase_seconds_count{" + phase + "} " + QByteArray::number(totals.phases[i].count) + '\n';
+	}
+
+	return result;
+}
+
+bool serve(const QString &path, QString &error)
+{
+	const QByteArray name = QFile::encodeName(path);
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (name.size() >= static_cast<int>(sizeof(address.sun_path))) {
+		error = QString{"metrics socket path too long: %1"}.arg(path);
+		return false;
+	}
+	memcpy(address.sun_path, name.constData(), name.size());
+
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		error = QString{"unable to create the metrics socket: %1"}.arg(strerror(errno));
+		return false;
+	}
+
+	// a stale socket of an earlier run is replaced, anything else at the path is left alone
+	struct stat info;
+	if (::lstat(name.constData(), &info) == 0) {
+		if (!S_ISSOCK(info.st_mode)) {
+			error = QString{"metrics socket path exists and is not a socket: %1"}.arg(path);
+			::close(fd);
+			return false;
+		}
+		::unlink(name.constData());
+	}
+	if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1 || ::listen(fd, 16) == -1) {
+		error = QString{"unable to listen on %1: %2"}.arg(path).arg(strerror(errno));
+		::close(fd);
+		return false;
+	}
+
+	std::thread{[fd](){
+		for (;;) {
+			const int client = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (client != -1) {
+				// a client that never sends its request or never reads the answer does not block the others for long
+				const timeval timeout{1, 0};
+				::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+				::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+				serveClient(client);
+			}
+			else if (errno != EINTR && errno != ECONNABORTED)
+				return;
+		}
+	}}.detach();
+	return true;
+}
+
+} // Metrics
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QtCore>
+
+/*
+ * Live numbers for a long-running converter, served in the Prometheus text
+ * format. Every thread counts into its own slab with plain relaxed stores,
+ * so recording never contends; a scrape sums the slabs of all threads,
+ * including those already gone.
+ */
+namespace Metrics {
+
+enum class Counter {
+	Documents,
+	BytesIn,
+	BytesOut,
+	CacheHits,
+	CacheMisses,
+	Count,
+};
+
+enum class Phase {
+	Parse,
+	Emit,
+	Highlight,
+	Package,
+	Count,
+};
+
+enum class Failure {
+	Usage, // missing template, unreadable macro file
+	Parse,
+	Budget,
+	Output,
+	Count,
+};
+
+void add(Counter counter, qint64 value = 1);
+void fail(Failure failure);
+void observe(Phase phase, qint64 nanoseconds);
+
+/*
+ * Times the scope into `phase`, excluding the time of timers nested in it,
+ * so that packaging does not count the emitting done inside of it.
+ */
+class PhaseTimer {
+public:
+	explicit PhaseTimer(Phase phase);
+	~PhaseTimer();
+
+private:
+	Phase m_phase;
+	QElapsedTimer m_timer;
+	qint64 m_outerNested;
+};
+
+QByteArray exposition();
+
+/*
+ * Serves exposition() over HTTP on a Unix socket at `path`, from a thread
+ * of its own, for as long as the process runs.
+ */
+bool serve(const QString &path, QString &error);
+
+} // Metrics
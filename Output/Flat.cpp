@@ -0,0 +1,258 @@
+#include "AllocStats.hpp"
+#include "AsyncIO.hpp"
+#include "Depends.hpp"
+#include "Diagnostics.hpp"
+#include "Document.hpp"
+#include "Metrics.hpp"
+#include "Output/Flat.hpp"
+
+namespace {
+
+const char *MimeType = "application/vnd.oasis.opendocument.text";
+
+QByteArray rootTag(const QByteArray &xml)
+{
+	int start = xml.indexOf('<');
+	while (start != -1 && start + 1 < xml.size() && (xml[start + 1] == '?' || xml[start + 1] == '!'))
+		start = xml.indexOf('<', start + 1);
+	if (start == -1)
+		return QByteArray{};
+
+	return xml.mid(start, xml.indexOf('>', start) + 1 - start);
+}
+
+QByteArray element(const QByteArray &xml, const QByteArray &name)
+{
+	const int start = xml.indexOf('<' + name);
+	if (start == -1)
+		return QByteArray{};
+
+	const int tagEnd = xml.indexOf('>', start);
+	if (tagEnd == -1)
+		return QByteArray{};
+	if (xml[tagEnd - 1] == '/')
+		return xml.mid(start, tagEnd + 1 - start);
+
+	const QByteArray endTag = "</" + name + '>';
+	const int end = xml.indexOf(endTag, tagEnd);
+	if (end == -1)
+		return QByteArray{};
+	return xml.mid(start, end + endTag.size() - start);
+}
+
+QByteArray contents(const QByteArray &element)
+{
+	const int start = element.indexOf('>') + 1;
+	const int end = element.lastIndexOf('<');
+	if (start == 0 || end < start)
+		return QByteArray{};
+	return element.mid(start, end - start);
+}
+
+QByteArray namespaces(std::initializer_list <QByteArray> roots)
+{
+	static const QRegularExpression Declaration{"xmlns:([\\w-]+)=\"[^\"]*\""};
+
+	QByteArray result;
+	QSet <QString> prefixes;
+	for (const QByteArray &root : roots) {
+		auto iter = Declaration.globalMatch(QString::fromUtf8(root));
+		while (iter.hasNext()) {
+			const QRegularExpressionMatch match = iter.next();
+			if (prefixes.contains(match.captured(1)))
+				continue;
+			prefixes.insert(match.captured(1));
+			result += ' ' + match.captured(0).toUtf8();
+		}
+	}
+
+	return result;
+}
+
+QByteArray version(const QByteArray &root)
+{
+	static const QRegularExpression Version{"office:version=\"([^\"]*)\""};
+	const QRegularExpressionMatch match = Version.match(QString::fromUtf8(root));
+	return match.hasMatch() ? match.captured(1).toUtf8() : QByteArray{"1.2"};
+}
+
+const QByteArray ImageStart = "<draw:image xlink:href=\"";
+const QByteArray ObjectStart = "<draw:object xlink:href=\"./";
+const QByteArray MathMLNamespace = "xmlns=\"http://www.w3.org/1998/Math/MathML\"";
+
+/*
+ * MathML as an office document embeds it: every element in the math
+ * namespace under the "math" prefix.
+ */
+QByteArray prefixed(const QByteArray &mathml)
+{
+	QByteArray result;
+	result.reserve(mathml.size() + mathml.size() / 4);
+	for (int idx = 0; idx < mathml.size(); ++idx) {
+		result += mathml[idx];
+		if (mathml[idx] != '<')
+			continue;
+		if (idx + 1 < mathml.size() && mathml[idx + 1] == '/')
+			result += mathml[++idx];
+		result += "math:";
+	}
+	result.replace(MathMLNamespace, "xmlns:math=\"http://www.w3.org/1998/Math/MathML\"");
+	return result;
+}
+
+/*
+ * A flat document has no package to put pictures and formula objects
+ * in, so the frames pointing there are rewritten on the way out: images
+ * carry their bytes as office:binary-data, formulas their MathML inline.
+ * The frames are produced by XmlGen and may be split across writes.
+ */
+class EmbeddingSink : public Sink {
+public:
+	EmbeddingSink(Sink &out, QHash <QByteArray, QByteArray> &&embedded) : m_out{out}, m_embedded{std::move(embedded)} {}
+
+private:
+	void doWrite(const char *data, qint64 size) override
+	{
+		if (!m_carry.isEmpty()) {
+			m_carry.append(data, size);
+			const QByteArray buffer = std::move(m_carry);
+			m_carry = QByteArray{};
+			scan(buffer.constData(), buffer.size());
+		} else {
+			scan(data, size);
+		}
+	}
+
+	bool doFinish() override
+	{
+		m_out.write(m_carry.constData(), m_carry.size());
+		m_carry.clear();
+		return true;
+	}
+
+	void scan(const char *data, qint64 size)
+	{
+		const QByteArray view = QByteArray::fromRawData(data, size);
+		int done = 0;
+		for (int start; (start = view.indexOf("<draw:", done)) != -1; ) {
+			const int end = view.indexOf('>', start);
+			if (end == -1) {
+				m_out.write(data + done, start - done);
+				m_carry.append(data + start, size - start);
+				return;
+			}
+
+			const QByteArray tag = QByteArray::fromRawData(data + start, end + 1 - start);
+			const QByteArray *replacement = nullptr;
+			if (tag.startsWith(ImageStart))
+				replacement = find(tag, ImageStart.size());
+			else if (tag.startsWith(ObjectStart))
+				replacement = find(tag, ObjectStart.size());
+
+			m_out.write(data + done, start - done);
+			if (replacement)
+				m_out << *replacement;
+			else
+				m_out.write(tag.constData(), tag.size());
+			done = end + 1;
+		}
+
+		// a frame may begin in the last few bytes
+		int keep = size;
+		for (int idx = std::max<qint64>(done, size - 5); idx < size; ++idx) {
+			if (data[idx] == '<') {
+				keep = idx;
+				break;
+			}
+		}
+		m_out.write(data + done, keep - done);
+		m_carry.append(data + keep, size - keep);
+	}
+
+	const QByteArray * find(const QByteArray &tag, int hrefStart) const
+	{
+		const int hrefEnd = tag.indexOf('"', hrefStart);
+		auto iter = m_embedded.constFind(tag.mid(hrefStart, hrefEnd - hrefStart));
+		return iter == m_embedded.constEnd() ? nullptr : &iter.value();
+	}
+
+	Sink &m_out;
+	QHash <QByteArray, QByteArray> m_embedded; // href -> element replacing the reference
+	QByteArray m_carry;
+};
+
+/*
+ * The embedded form of every image and formula of `doc`, by href.
+ */
+bool embeddedObjects(const Document &doc, QHash <QByteArray, QByteArray> &result)
+{
+	QStringList paths;
+	for (const Image &image : doc.images.all())
+		paths.append(image.source);
+
+	ReadBatch batch = readFiles(paths);
+	bool ok = true;
+	for (int i = 0; i < paths.count(); ++i) {
+		std::optional <QByteArray> data = batch.files[i].get();
+		if (!data) {
+			Diagnostics::error(QString{"unable to open image: %1"}.arg(paths[i]));
+			ok = false;
+			continue;
+		}
+		Depends::record(paths[i], *data);
+		result.insert(doc.images.all()[i].href.toUtf8(),
+			"<draw:image><office:binary-data>" + data->toBase64() + "</office:binary-data></draw:image>");
+	}
+
+	for (const Formula &formula : doc.formulas.all())
+		result.insert(formula.href.toUtf8(), "<draw:object>" + prefixed(formula.mathml.get()) + "</draw:object>");
+	return ok;
+}
+
+}
+
+bool writeFlat(const Document &doc, const Template &tmpl, Sink &out)
+{
+	ALLOC_PHASE("package");
+	Metrics::PhaseTimer timer{Metrics::Phase::Package};
+	const QByteArray meta = tmpl.metaWithTitle(doc.titleText());
+	const QByteArray contentRoot = rootTag(tmpl.contentHeader);
+
+	const int bodyStart = tmpl.contentHeader.indexOf("<office:body");
+	if (contentRoot.isEmpty() || bodyStart == -1) {
+		Diagnostics::error("template: content.header.xml does not contain office:body");
+		return false;
+	}
+
+	QByteArray fontFaces = element(tmpl.styles, "office:font-face-decls");
+	if (fontFaces.isEmpty())
+		fontFaces = element(tmpl.contentHeader, "office:font-face-decls");
+
+	out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		<< "<office:document" << namespaces({contentRoot, rootTag(tmpl.styles), rootTag(meta)})
+		<< " office:version=\"" << version(contentRoot) << "\" office:mimetype=\"" << MimeType << "\">";
+
+	out << element(meta, "office:meta")
+		<< fontFaces
+		<< element(tmpl.styles, "office:styles")
+		<< "<office:automatic-styles>"
+		<< contents(element(tmpl.styles, "office:automatic-styles"))
+		<< contents(element(tmpl.contentHeader, "office:automatic-styles"))
+		<< "</office:automatic-styles>"
+		<< element(tmpl.styles, "office:master-styles");
+
+	QHash <QByteArray, QByteArray> embedded;
+	if (!embeddedObjects(doc, embedded))
+		return false;
+
+	out << tmpl.contentHeader.mid(bodyStart);
+	EmbeddingSink body{out, std::move(embedded)};
+	if (!doc.output(body) || !body.finish())
+		return false;
+
+	QByteArray footer = tmpl.contentFooter;
+	footer.replace("</office:document-content>", "</office:document>");
+	out << footer;
+
+	return true;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Output/Sink.hpp"
+#include "Output/Template.hpp"
+
+struct Document;
+
+/*
+ * Flat ODF: meta, styles and body in a single office:document, assembled
+ * from the template parts and streamed out together with the body.
+ */
+bool writeFlat(const Document &doc, const Template &tmpl, Sink &out);
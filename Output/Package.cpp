@@ -0,0 +1,140 @@
+#include "AllocStats.hpp"
+#include "Depends.hpp"
+#include "Diagnostics.hpp"
+#include "Document.hpp"
+#include "Metrics.hpp"
+#include "Output/Package.hpp"
+#include "Output/Styles.hpp"
+
+namespace {
+
+const char *XmlMediaType = "text/xml";
+const char *FormulaMediaType = "application/vnd.oasis.opendocument.formula";
+
+}
+
+Package::Package(Sink &out, int level, int threads, const char *mimeType) : m_zip{out, level, threads}, m_mimeType{mimeType}
+{
+	m_zip.addFile("mimetype", QByteArray{m_mimeType}, ZipWriter::Method::Stored);
+}
+
+void Package::addFile(const QString &path, const char *data, qint64 size, const QString &mediaType, ZipWriter::Method method)
+{
+	m_zip.addFile(path.toUtf8(), data, size, method);
+	m_manifest.append({path, mediaType});
+}
+
+void Package::addFile(const QString &path, const QByteArray &data, const QString &mediaType, ZipWriter::Method method)
+{
+	addFile(path, data.constData(), data.size(), mediaType, method);
+}
+
+/*
+ * PNG and JPEG data is compressed already: the file is mapped and copied
+ * into a stored entry as it is.
+ */
+bool Package::addImage(const Image &image)
+{
+	QFile file{image.source};
+	if (!file.open(QIODevice::ReadOnly)) {
+		Diagnostics::error(QString{"unable to open image: %1"}.arg(image.source));
+		return false;
+	}
+
+	const uchar *data = file.map(0, file.size());
+	if (data == nullptr) {
+		Diagnostics::error(QString{"unable to map image: %1"}.arg(image.source));
+		return false;
+	}
+	Depends::record(image.source, QByteArray::fromRawData(reinterpret_cast<const char *>(data), file.size()));
+
+	addFile(image.href, reinterpret_cast<const char *>(data), file.size(), image.mediaType, ZipWriter::Method::Stored);
+	return true;
+}
+
+/*
+ * Every formula is a sub-document of its own: a directory with the MathML
+ * as content.xml, listed in the manifest with the formula media type.
+ */
+void Package::addFormula(const Formula &formula)
+{
+	QByteArray content{"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"};
+	content.append(formula.mathml.get());
+	addFile(formula.href + "/content.xml", content, XmlMediaType);
+	m_manifest.append({formula.href + "/", FormulaMediaType});
+}
+
+std::unique_ptr <Sink> Package::openFile(const QString &path, const QString &mediaType)
+{
+	m_manifest.append({path, mediaType});
+	return m_zip.openFile(path.toUtf8());
+}
+
+bool Package::finish()
+{
+	QByteArray manifest;
+	manifest.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	manifest.append("<manifest:manifest xmlns:manifest=\"urn:oasis:names:tc:opendocument:xmlns:manifest:1.0\" manifest:version=\"1.2\">\n");
+	manifest.append(QString{" <manifest:file-entry manifest:full-path=\"/\" manifest:version=\"1.2\" manifest:media-type=\"%1\"/>\n"}.arg(m_mimeType).toUtf8());
+	for (const auto &entry : m_manifest)
+		manifest.append(QString{" <manifest:file-entry manifest:full-path=\"%1\" manifest:media-type=\"%2\"/>\n"}.arg(entry.first).arg(entry.second).toUtf8());
+	manifest.append("</manifest:manifest>\n");
+
+	m_zip.addFile("META-INF/manifest.xml", manifest);
+	return m_zip.finish();
+}
+
+namespace {
+
+/*
+ * `trailer` goes into the body of content.xml, after the document.
+ */
+bool writePackage(const Document &doc, const Template &tmpl, Sink &out, int level, int threads, const char *mimeType, const QByteArray &trailer)
+{
+	ALLOC_PHASE("package");
+	Metrics::PhaseTimer timer{Metrics::Phase::Package};
+	Package package{out, level, threads, mimeType};
+
+	std::unique_ptr <Sink> content = package.openFile("content.xml", XmlMediaType);
+	StyleTracker tracker{*content};
+	tracker << tmpl.contentHeader;
+	bool result = doc.output(tracker);
+	tracker << trailer;
+	tracker << tmpl.contentFooter;
+	result = content->finish() && result;
+
+	package.addFile("styles.xml", tmpl.styleSheet.trimmed(tracker.used()), XmlMediaType);
+
+	package.addFile("meta.xml", tmpl.metaWithTitle(doc.titleText()), XmlMediaType);
+
+	for (const Image &image : doc.images.all())
+		result = result && package.addImage(image);
+
+	for (const Formula &formula : doc.formulas.all())
+		package.addFormula(formula);
+
+	return result && package.finish();
+}
+
+}
+
+bool writeOdt(const Document &doc, const Template &tmpl, Sink &out, int level, int threads)
+{
+	return writePackage(doc, tmpl, out, level, threads, Package::Text, {});
+}
+
+/*
+ * Every chapter is a protected section sourced from its file; the office
+ * suite fills it in from there when the master is opened.
+ */
+bool writeMaster(const Document &doc, const QStringList &chapters, const Template &tmpl, Sink &out, int level, int threads)
+{
+	QByteArray links;
+	for (const QString &chapter : chapters) {
+		const QString name = chapter.toHtmlEscaped();
+		links.append(QString{"<text:section text:name=\"%1\" text:protected=\"true\">"
+			"<text:section-source xlink:href=\"../%1\" xlink:type=\"simple\" text:filter-name=\"writer8\"/>"
+			"</text:section>"}.arg(name).toUtf8());
+	}
+	return writePackage(doc, tmpl, out, level, threads, Package::TextMaster, links);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <QtCore>
+
+#include "Output/Template.hpp"
+#include "Output/Zip.hpp"
+
+struct Document;
+struct Formula;
+struct Image;
+
+/*
+ * ODF package: the mimetype entry goes first and uncompressed, every other
+ * file is recorded and listed in META-INF/manifest.xml by finish().
+ */
+class Package {
+public:
+	static constexpr const char *Text = "application/vnd.oasis.opendocument.text";
+	static constexpr const char *TextMaster = "application/vnd.oasis.opendocument.text-master";
+
+	explicit Package(Sink &out, int level = Z_DEFAULT_COMPRESSION, int threads = 1, const char *mimeType = Text);
+
+	void addFile(const QString &path, const char *data, qint64 size, const QString &mediaType,
+		ZipWriter::Method method = ZipWriter::Method::Deflated);
+	void addFile(const QString &path, const QByteArray &data, const QString &mediaType,
+		ZipWriter::Method method = ZipWriter::Method::Deflated);
+	bool addImage(const Image &image);
+	void addFormula(const Formula &formula);
+	std::unique_ptr <Sink> openFile(const QString &path, const QString &mediaType);
+
+	bool finish();
+
+private:
+	ZipWriter m_zip;
+	const char *m_mimeType;
+	QVector <QPair <QString, QString> > m_manifest;
+};
+
+bool writeOdt(const Document &doc, const Template &tmpl, Sink &out, int level, int threads);
+
+/*
+ * .odm master document: `doc` is the part before the first chapter, and
+ * each of `chapters` is linked by its file name, relative to the master.
+ */
+bool writeMaster(const Document &doc, const QStringList &chapters, const Template &tmpl, Sink &out, int level, int threads);
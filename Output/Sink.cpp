@@ -0,0 +1,149 @@
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+
+#include "AsyncIO.hpp"
+#include "Diagnostics.hpp"
+#include "Output/Sink.hpp"
+
+FdSink::FdSink(int fd, int bufferSize) : m_fd{fd}, m_bufferSize{bufferSize}
+{
+	m_buffer.reserve(m_bufferSize);
+
+	auto ring = std::make_unique<IoUring>(2);
+	if (ring->valid() && ring->currentPosition()) {
+		m_ring = std::move(ring);
+		m_writing.reserve(m_bufferSize);
+	}
+}
+
+FdSink::~FdSink()
+{
+	flush();
+	if (m_ring)
+		waitWrite();
+}
+
+void FdSink::doWrite(const char *data, qint64 size)
+{
+	if (m_buffer.size() + size > m_bufferSize) {
+		flush();
+		if (size >= m_bufferSize) {
+			writeAll(data, size);
+			return;
+		}
+	}
+
+	m_buffer.append(data, size);
+}
+
+bool FdSink::doFinish()
+{
+	return flush() && (!m_ring || waitWrite()) && !m_failed;
+}
+
+bool FdSink::flush()
+{
+	if (m_buffer.isEmpty())
+		return true;
+
+	if (m_ring) {
+		if (!waitWrite()) {
+			m_buffer.resize(0);
+			return false;
+		}
+		std::swap(m_buffer, m_writing);
+		m_buffer.resize(0);
+		m_written = 0;
+		return submitWrite();
+	}
+
+	const bool result = writeAll(m_buffer.constData(), m_buffer.size());
+	m_buffer.resize(0);
+	return result;
+}
+
+bool FdSink::writeAll(const char *data, qint64 size)
+{
+	if (m_failed || (m_ring && !waitWrite()))
+		return false;
+
+	while (size > 0) {
+		const ssize_t written = ::write(m_fd, data, size);
+		if (written == -1) {
+			if (errno == EINTR)
+				continue;
+			Diagnostics::error(QString{"write failed: %1"}.arg(strerror(errno)));
+			m_failed = true;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+
+	return true;
+}
+
+/*
+ * One write is in flight at a time, at the file position, so the output
+ * stays in order; a short write is continued with the rest.
+ */
+bool FdSink::submitWrite()
+{
+	if (!m_ring->prepareWrite(m_fd, m_writing.constData() + m_written, m_writing.size() - m_written, quint64(-1), 0)
+		|| !m_ring->submit()) {
+		Diagnostics::error("write failed: unable to submit to io_uring");
+		m_failed = true;
+		return false;
+	}
+
+	m_pending = true;
+	return true;
+}
+
+bool FdSink::waitWrite()
+{
+	while (m_pending) {
+		m_pending = false;
+		quint64 userData;
+		int result;
+		if (!m_ring->wait(userData, result)) {
+			Diagnostics::error("write failed: unable to wait on io_uring");
+			m_failed = true;
+			return false;
+		}
+
+		// a non-blocking descriptor that is full would fail at once again
+		if (result == -EAGAIN && !waitWritable())
+			return false;
+
+		if (result == -EINTR || result == -EAGAIN) {
+			result = 0;
+		} else if (result <= 0) {
+			Diagnostics::error(QString{"write failed: %1"}.arg(result == 0 ? QString{"no progress"} : QString{strerror(-result)}));
+			m_failed = true;
+			return false;
+		}
+
+		m_written += result;
+		if (m_written < m_writing.size() && !submitWrite())
+			return false;
+	}
+
+	return !m_failed;
+}
+
+bool FdSink::waitWritable()
+{
+	pollfd request{m_fd, POLLOUT, 0};
+	for (;;) {
+		if (::poll(&request, 1, -1) != -1)
+			return true;
+		if (errno != EINTR) {
+			Diagnostics::error(QString{"write failed: %1"}.arg(strerror(errno)));
+			m_failed = true;
+			return false;
+		}
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <QtCore>
+
+/*
+ * Byte-oriented output for the generated XML. Everything written here is
+ * already UTF-8, sinks never transcode.
+ */
+class Sink {
+public:
+	virtual ~Sink() = default;
+
+	void write(const char *data, qint64 size) { doWrite(data, size); }
+	bool finish() { return doFinish(); }
+
+	Sink & operator << (const char *data)
+	{
+		doWrite(data, qstrlen(data));
+		return *this;
+	}
+
+	Sink & operator << (const QByteArray &data)
+	{
+		doWrite(data.constData(), data.size());
+		return *this;
+	}
+
+private:
+	virtual void doWrite(const char *data, qint64 size) = 0;
+	virtual bool doFinish() { return true; }
+};
+
+class IoUring;
+
+/*
+ * Buffered writes to a file descriptor. Where io_uring is available a full
+ * buffer is written asynchronously while the next one is being filled.
+ */
+class FdSink : public Sink {
+public:
+	static constexpr int DefaultBufferSize = 4 << 20;
+
+	explicit FdSink(int fd, int bufferSize = DefaultBufferSize);
+	~FdSink() override;
+
+private:
+	void doWrite(const char *data, qint64 size) override;
+	bool doFinish() override;
+	bool flush();
+	bool writeAll(const char *data, qint64 size);
+	bool submitWrite();
+	bool waitWrite();
+	bool waitWritable();
+
+	int m_fd;
+	int m_bufferSize;
+	QByteArray m_buffer;
+	bool m_failed = false;
+
+	std::unique_ptr <IoUring> m_ring;
+	QByteArray m_writing; // the buffer the kernel is writing from
+	qint64 m_written = 0;
+	bool m_pending = false;
+};
+
+class BufferSink : public Sink {
+public:
+	const QByteArray & data() const { return m_data; }
+	QByteArray take() { return std::move(m_data); }
+
+private:
+	void doWrite(const char *data, qint64 size) override { m_data.append(data, size); }
+
+	QByteArray m_data;
+};
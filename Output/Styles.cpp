@@ -0,0 +1,184 @@
+#include "Output/Styles.hpp"
+#include "Stats.hpp"
+
+namespace {
+
+/*
+ * Adds the values of all *style-name attributes in `xml` to `names`.
+ */
+void collectReferences(const QByteArray &xml, QSet <QByteArray> &names)
+{
+	static const QByteArray Attribute{"style-name=\""};
+	for (int idx = xml.indexOf(Attribute); idx != -1; idx = xml.indexOf(Attribute, idx)) {
+		idx += Attribute.size();
+		const int end = xml.indexOf('"', idx);
+		if (end == -1)
+			return;
+
+		const QByteArray name = QByteArray::fromRawData(xml.constData() + idx, end - idx);
+		if (!names.contains(name))
+			names.insert(QByteArray{name.constData(), name.size()});
+		idx = end;
+	}
+}
+
+/*
+ * Index just past the element starting at `begin`, -1 if it is not closed.
+ */
+int elementEnd(const QByteArray &xml, int begin)
+{
+	int depth = 0;
+	for (int idx = begin; idx != -1 && idx + 1 < xml.size(); idx = xml.indexOf('<', idx)) {
+		const int tagEnd = xml.indexOf('>', idx);
+		if (tagEnd == -1)
+			return -1;
+
+		const char kind = xml[idx + 1];
+		if (kind == '/')
+			--depth;
+		else if (kind != '!' && kind != '?' && xml[tagEnd - 1] != '/')
+			++depth;
+
+		if (depth == 0)
+			return tagEnd + 1;
+		idx = tagEnd;
+	}
+	return -1;
+}
+
+QByteArray styleName(const QByteArray &element)
+{
+	static const QByteArray Attribute{"style:name=\""};
+	if (!element.startsWith("<style:style ") && !element.startsWith("<text:list-style "))
+		return QByteArray{};
+
+	const int tagEnd = element.indexOf('>');
+	const int start = element.indexOf(Attribute);
+	if (start == -1 || start > tagEnd)
+		return QByteArray{};
+
+	const int valueStart = start + Attribute.size();
+	return element.mid(valueStart, element.indexOf('"', valueStart) - valueStart);
+}
+
+}
+
+bool StyleSheet::parse(const QByteArray &xml)
+{
+	m_source = xml;
+	m_styles.clear();
+	m_byName.clear();
+	m_referenced.clear();
+	m_parsed = false;
+
+	const int open = xml.indexOf("<office:styles");
+	const int openEnd = xml.indexOf('>', open);
+	const int close = xml.indexOf("</office:styles>", openEnd);
+	if (open == -1 || openEnd == -1 || close == -1)
+		return false;
+
+	m_head = xml.left(openEnd + 1);
+	m_tail = xml.mid(close);
+	collectReferences(m_head, m_referenced);
+	collectReferences(m_tail, m_referenced);
+
+	int idx = openEnd + 1;
+	while (idx < close) {
+		const int begin = xml.indexOf('<', idx);
+		if (begin == -1 || begin >= close) {
+			m_styles.append(Style{QByteArray{}, xml.mid(idx, close - idx), {}});
+			break;
+		}
+
+		const int end = elementEnd(xml, begin);
+		if (end == -1 || end > close)
+			return false;
+
+		Style style;
+		style.name = styleName(xml.mid(begin, end - begin));
+		style.xml = xml.mid(idx, end - idx);
+		collectReferences(style.xml, style.references);
+		style.references.remove(style.name);
+		if (!style.name.isEmpty())
+			m_byName.insert(style.name, m_styles.count());
+		m_styles.append(std::move(style));
+		idx = end;
+	}
+
+	m_parsed = true;
+	return true;
+}
+
+QByteArray StyleSheet::trimmed(const QSet <QByteArray> &used) const
+{
+	if (!m_parsed)
+		return m_source;
+
+	QVector <bool> keep(m_styles.count(), false);
+	QVector <int> pending;
+	auto use = [this, &keep, &pending](const QByteArray &name){
+		for (auto iter = m_byName.constFind(name); iter != m_byName.constEnd() && iter.key() == name; ++iter) {
+			if (!keep[iter.value()]) {
+				keep[iter.value()] = true;
+				pending.append(iter.value());
+			}
+		}
+	};
+
+	for (int i = 0; i < m_styles.count(); ++i) {
+		if (m_styles[i].name.isEmpty()) {
+			keep[i] = true;
+			pending.append(i);
+		}
+	}
+	for (const QByteArray &name : used)
+		use(name);
+	for (const QByteArray &name : m_referenced)
+		use(name);
+
+	while (!pending.isEmpty()) {
+		const int idx = pending.takeLast();
+		for (const QByteArray &name : m_styles[idx].references)
+			use(name);
+	}
+
+	QByteArray result;
+	result.reserve(m_source.size());
+	result.append(m_head);
+	int kept = 0;
+	for (int i = 0; i < m_styles.count(); ++i) {
+		if (!keep[i])
+			continue;
+		result.append(m_styles[i].xml);
+		kept += !m_styles[i].name.isEmpty();
+	}
+	result.append(m_tail);
+
+	Stats::add("styles.kept", kept);
+	Stats::add("styles.dropped", m_byName.count() - kept);
+	return result;
+}
+
+/*
+ * An attribute may be split across writes, so a tag still open at the end
+ * of a write is scanned again along with the next one.
+ */
+void StyleTracker::doWrite(const char *data, qint64 size)
+{
+	m_out.write(data, size);
+
+	QByteArray buffer;
+	if (!m_tail.isEmpty()) {
+		buffer = std::move(m_tail);
+		buffer.append(data, size);
+	} else {
+		buffer = QByteArray::fromRawData(data, size);
+	}
+	collectReferences(buffer, m_used);
+
+	const int open = buffer.lastIndexOf('<');
+	if (open != -1 && buffer.indexOf('>', open) == -1)
+		m_tail = QByteArray{buffer.constData() + open, buffer.size() - open}; // a copy, `data` is gone after returning
+	else
+		m_tail.clear();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QtCore>
+
+#include "Output/Sink.hpp"
+
+/*
+ * styles.xml split into its named common styles, so that a package only
+ * carries the definitions its content refers to. Paragraph, text and list
+ * styles are dropped unless used, directly or through another kept style;
+ * everything else in the file is always kept.
+ */
+class StyleSheet {
+public:
+	bool parse(const QByteArray &xml);
+	QByteArray trimmed(const QSet <QByteArray> &used) const;
+
+private:
+	struct Style {
+		QByteArray name; // empty for what is always kept
+		QByteArray xml; // including the whitespace in front
+		QSet <QByteArray> references;
+	};
+
+	QByteArray m_source;
+	QByteArray m_head;
+	QByteArray m_tail;
+	QVector <Style> m_styles;
+	QMultiHash <QByteArray, int> m_byName;
+	QSet <QByteArray> m_referenced; // from outside the common styles
+	bool m_parsed = false;
+};
+
+/*
+ * Forwards everything to `out`, collecting the style names referenced by
+ * the XML passing through.
+ */
+class StyleTracker : public Sink {
+public:
+	explicit StyleTracker(Sink &out) : m_out{out} {}
+
+	const QSet <QByteArray> & used() const { return m_used; }
+
+private:
+	void doWrite(const char *data, qint64 size) override;
+
+	Sink &m_out;
+	QSet <QByteArray> m_used;
+	QByteArray m_tail; // an unfinished tag of the last write
+};
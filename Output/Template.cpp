@@ -0,0 +1,51 @@
+#include "AsyncIO.hpp"
+#include "Diagnostics.hpp"
+#include "Output/Template.hpp"
+
+/*
+ * The four files are read as one batch.
+ */
+bool Template::load(const QString &dir)
+{
+	const QDir templateDir{dir};
+	const QStringList paths{
+		templateDir.filePath("content.header.xml"),
+		templateDir.filePath("content.footer.xml"),
+		templateDir.filePath("styles.xml"),
+		templateDir.filePath("meta.xml"),
+	};
+	QByteArray * const parts[] = {&contentHeader, &contentFooter, &styles, &meta};
+
+	ReadBatch batch = readFiles(paths);
+	bool result = true;
+	for (int i = 0; i < paths.count(); ++i) {
+		std::optional <QByteArray> data = batch.files[i].get();
+		if (!data) {
+			Diagnostics::error(QString{"unable to open template file: %1"}.arg(paths[i]));
+			result = false;
+			continue;
+		}
+		*parts[i] = std::move(*data);
+		files.insert(paths[i], *parts[i]);
+	}
+
+	if (result && !styleSheet.parse(styles))
+		Diagnostics::warning("template: styles.xml has no office:styles to trim, packages get all of it");
+	return result;
+}
+
+/*
+ * `title` is plain text; it is escaped and spliced in literally.
+ */
+QByteArray Template::metaWithTitle(const QString &title) const
+{
+	const QByteArray Open = "<dc:title>";
+	const int begin = meta.indexOf(Open);
+	const int end = meta.indexOf("</dc:title>", begin);
+	if (title.isEmpty() || begin == -1 || end == -1)
+		return meta;
+
+	QByteArray result = meta;
+	result.replace(begin + Open.size(), end - begin - Open.size(), title.toHtmlEscaped().toUtf8());
+	return result;
+}
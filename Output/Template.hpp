@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QtCore>
+
+#include "Output/Styles.hpp"
+
+/*
+ * The fixed parts of a generated document: the XML surrounding the body
+ * of content.xml, styles.xml and meta.xml. styles.xml is parsed once
+ * here, so that every package can take just the styles it uses.
+ */
+struct Template {
+	bool load(const QString &dir);
+	QByteArray metaWithTitle(const QString &title) const;
+
+	QByteArray contentHeader;
+	QByteArray contentFooter;
+	QByteArray styles;
+	StyleSheet styleSheet;
+	QByteArray meta;
+	QHash <QString, QByteArray> files; // path -> content as loaded, for Depends
+};
@@ -0,0 +1,354 @@
+#include <deque>
+#include <future>
+
+#include "AllocStats.hpp"
+#include "Diagnostics.hpp"
+#include "Output/Zip.hpp"
+#include "Tasks.hpp"
+
+namespace {
+
+constexpr quint32 LocalHeaderSignature = 0x04034b50;
+constexpr quint32 DataDescriptorSignature = 0x08074b50;
+constexpr quint32 CentralHeaderSignature = 0x02014b50;
+constexpr quint32 EndOfCentralDirSignature = 0x06054b50;
+constexpr quint16 ZipVersion = 20;
+constexpr quint16 FlagDataDescriptor = 1 << 3;
+constexpr int ChunkSize = 128 << 10;
+constexpr int DictionarySize = 32 << 10;
+
+void put16(QByteArray &out, quint16 value)
+{
+	out.append(static_cast<char>(value & 0xff));
+	out.append(static_cast<char>(value >> 8));
+}
+
+void put32(QByteArray &out, quint32 value)
+{
+	put16(out, value & 0xffff);
+	put16(out, value >> 16);
+}
+
+quint32 crcOf(quint32 crc, const char *data, qint64 size)
+{
+	if (size == 0)
+		return crc;
+	return crc32(crc, reinterpret_cast<const Bytef *>(data), size);
+}
+
+bool initDeflate(z_stream &stream, int level)
+{
+	stream = z_stream{};
+	if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		Diagnostics::error(QString{"deflateInit2 failed, level = %1"}.arg(level));
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Deflates the whole input of `stream` into `out`, growing it as needed.
+ * Z_FINISH has to end the stream, any other flush has to consume all input.
+ */
+bool deflateInto(z_stream &stream, QByteArray &out, int flush)
+{
+	out.resize(deflateBound(&stream, stream.avail_in) + 16);
+	stream.next_out = reinterpret_cast<Bytef *>(out.data());
+	stream.avail_out = out.size();
+
+	for (;;) {
+		const int status = deflate(&stream, flush);
+		const bool grow = (stream.avail_out == 0);
+		if (status != Z_OK && status != Z_STREAM_END && !(status == Z_BUF_ERROR && grow)) {
+			Diagnostics::error(QString{"deflate failed: %1"}.arg(stream.msg ? stream.msg : QString::number(status)));
+			return false;
+		}
+		if (!grow && (flush == Z_FINISH ? status == Z_STREAM_END : stream.avail_in == 0))
+			break;
+		if (!grow) {
+			Diagnostics::error(QString{"deflate made no progress, flush = %1"}.arg(flush));
+			return false;
+		}
+
+		const int used = out.size();
+		out.resize(2 * used);
+		stream.next_out = reinterpret_cast<Bytef *>(out.data() + used);
+		stream.avail_out = used;
+	}
+
+	out.resize(stream.total_out);
+	return true;
+}
+
+}
+
+/*
+ * Entries are compressed pigz-style: the input is cut into chunks that are
+ * deflated independently, each primed with the tail of its predecessor as
+ * dictionary and ended with a sync flush, so their concatenation is a single
+ * valid deflate stream. Up to m_threads chunks are compressed concurrently
+ * by a pool of as many workers and written out in order; the CRCs are
+ * combined per chunk.
+ */
+class ZipEntrySink : public Sink {
+public:
+	ZipEntrySink(ZipWriter &zip, ZipWriter::Entry &&entry) : m_zip{zip}, m_entry{std::move(entry)}
+	{
+		m_pending.reserve(ChunkSize);
+		m_pool.setMaxThreadCount(m_zip.m_threads);
+	}
+
+	~ZipEntrySink() override
+	{
+		close();
+	}
+
+private:
+	struct CompressedChunk {
+		QByteArray data;
+		quint32 crc;
+		qint64 size;
+		bool ok;
+	};
+
+	void doWrite(const char *data, qint64 size) override
+	{
+		while (size > 0) {
+			const qint64 count = std::min<qint64>(size, ChunkSize - m_pending.size());
+			m_pending.append(data, count);
+			data += count;
+			size -= count;
+
+			if (m_pending.size() == ChunkSize)
+				submit(false);
+		}
+	}
+
+	bool doFinish() override
+	{
+		close();
+		return !m_zip.m_failed;
+	}
+
+	void close()
+	{
+		if (m_closed)
+			return;
+		m_closed = true;
+
+		submit(true);
+		while (!m_inFlight.empty()) {
+			writeChunk(m_inFlight.front().get());
+			m_inFlight.pop_front();
+		}
+
+		QByteArray descriptor;
+		put32(descriptor, DataDescriptorSignature);
+		put32(descriptor, m_entry.crc);
+		put32(descriptor, m_entry.compressedSize);
+		put32(descriptor, m_entry.size);
+		m_zip.writeRaw(descriptor.constData(), descriptor.size());
+
+		m_zip.m_entries.push_back(m_entry);
+		m_zip.m_entryOpen = false;
+	}
+
+	void submit(bool last)
+	{
+		QByteArray input = std::move(m_pending);
+		QByteArray dictionary = std::move(m_dictionary);
+		if (!last)
+			m_dictionary = input.right(DictionarySize);
+		m_pending = QByteArray{};
+		m_pending.reserve(ChunkSize);
+
+		if (m_zip.m_threads <= 1) {
+			writeChunk(compress(input, dictionary, m_zip.m_level, last));
+			return;
+		}
+
+		m_inFlight.push_back(runTask(m_pool, [input = std::move(input), dictionary = std::move(dictionary), level = m_zip.m_level, last, diagnostics = Diagnostics::current()](){
+			Diagnostics::Scope scope{diagnostics};
+			return compress(input, dictionary, level, last);
+		}));
+		if (static_cast<int>(m_inFlight.size()) >= m_zip.m_threads) {
+			writeChunk(m_inFlight.front().get());
+			m_inFlight.pop_front();
+		}
+	}
+
+	void writeChunk(const CompressedChunk &chunk)
+	{
+		if (!chunk.ok) {
+			Diagnostics::error(QString{"unable to compress %1"}.arg(m_entry.name));
+			m_zip.m_failed = true;
+		}
+		m_zip.writeRaw(chunk.data.constData(), chunk.data.size());
+		m_entry.compressedSize += chunk.data.size();
+		m_entry.crc = crc32_combine(m_entry.crc, chunk.crc, chunk.size);
+		m_entry.size += chunk.size;
+	}
+
+	static CompressedChunk compress(const QByteArray &input, const QByteArray &dictionary, int level, bool last)
+	{
+		ALLOC_PHASE("package");
+		CompressedChunk result;
+		result.crc = crcOf(0, input.constData(), input.size());
+		result.size = input.size();
+
+		z_stream stream;
+		result.ok = initDeflate(stream, level);
+		if (!result.ok)
+			return result;
+		if (!dictionary.isEmpty() && deflateSetDictionary(&stream, reinterpret_cast<const Bytef *>(dictionary.constData()), dictionary.size()) != Z_OK) {
+			Diagnostics::error("deflateSetDictionary failed");
+			deflateEnd(&stream);
+			result.ok = false;
+			return result;
+		}
+
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+		stream.avail_in = input.size();
+		result.ok = deflateInto(stream, result.data, last ? Z_FINISH : Z_SYNC_FLUSH);
+		deflateEnd(&stream);
+		return result;
+	}
+
+	ZipWriter &m_zip;
+	ZipWriter::Entry m_entry;
+	QByteArray m_pending;
+	QByteArray m_dictionary;
+	std::deque <std::future <CompressedChunk> > m_inFlight;
+	QThreadPool m_pool;
+	bool m_closed = false;
+};
+
+ZipWriter::ZipWriter(Sink &out, int level, int threads) : m_out{out}, m_level{level}, m_threads{threads}
+{
+	const QDateTime now = QDateTime::currentDateTime();
+	const QTime time = now.time();
+	const QDate date = now.date();
+	m_dosTime = (time.hour() << 11) | (time.minute() << 5) | (time.second() / 2);
+	m_dosDate = ((date.year() - 1980) << 9) | (date.month() << 5) | date.day();
+}
+
+void ZipWriter::addFile(const QByteArray &name, const char *data, qint64 size, Method method)
+{
+	Q_ASSERT(!m_entryOpen);
+
+	Entry entry{name, method, 0, crcOf(0, data, size), 0, static_cast<quint32>(size), m_offset};
+	if (method == Method::Stored) {
+		entry.compressedSize = size;
+		writeLocalHeader(entry);
+		writeRaw(data, size);
+	} else {
+		z_stream stream;
+		if (!initDeflate(stream, m_level)) {
+			m_failed = true;
+			return;
+		}
+
+		QByteArray compressed;
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+		stream.avail_in = size;
+		const bool ok = deflateInto(stream, compressed, Z_FINISH);
+		deflateEnd(&stream);
+		if (!ok) {
+			Diagnostics::error(QString{"unable to compress %1"}.arg(name));
+			m_failed = true;
+			return;
+		}
+
+		entry.compressedSize = compressed.size();
+		writeLocalHeader(entry);
+		writeRaw(compressed.constData(), entry.compressedSize);
+	}
+
+	m_entries.push_back(std::move(entry));
+}
+
+void ZipWriter::addFile(const QByteArray &name, const QByteArray &data, Method method)
+{
+	addFile(name, data.constData(), data.size(), method);
+}
+
+std::unique_ptr <Sink> ZipWriter::openFile(const QByteArray &name)
+{
+	Q_ASSERT(!m_entryOpen);
+	m_entryOpen = true;
+
+	Entry entry{name, Method::Deflated, FlagDataDescriptor, 0, 0, 0, m_offset};
+	writeLocalHeader(entry);
+	return std::make_unique<ZipEntrySink>(*this, std::move(entry));
+}
+
+bool ZipWriter::finish()
+{
+	if (m_entryOpen) {
+		Diagnostics::error("ZipWriter::finish() called with an open entry");
+		return false;
+	}
+	if (m_failed)
+		return false;
+
+	const quint32 centralDirOffset = m_offset;
+	QByteArray centralDir;
+	for (const Entry &entry : m_entries) {
+		put32(centralDir, CentralHeaderSignature);
+		put16(centralDir, ZipVersion);
+		put16(centralDir, ZipVersion);
+		put16(centralDir, entry.flags);
+		put16(centralDir, static_cast<quint16>(entry.method));
+		put16(centralDir, m_dosTime);
+		put16(centralDir, m_dosDate);
+		put32(centralDir, entry.crc);
+		put32(centralDir, entry.compressedSize);
+		put32(centralDir, entry.size);
+		put16(centralDir, entry.name.size());
+		put16(centralDir, 0); // extra field length
+		put16(centralDir, 0); // comment length
+		put16(centralDir, 0); // disk number
+		put16(centralDir, 0); // internal attributes
+		put32(centralDir, 0); // external attributes
+		put32(centralDir, entry.offset);
+		centralDir.append(entry.name);
+	}
+
+	const quint32 centralDirSize = centralDir.size();
+	put32(centralDir, EndOfCentralDirSignature);
+	put16(centralDir, 0);
+	put16(centralDir, 0);
+	put16(centralDir, m_entries.count());
+	put16(centralDir, m_entries.count());
+	put32(centralDir, centralDirSize);
+	put32(centralDir, centralDirOffset);
+	put16(centralDir, 0);
+
+	writeRaw(centralDir.constData(), centralDir.size());
+	return true;
+}
+
+void ZipWriter::writeLocalHeader(const Entry &entry)
+{
+	QByteArray header;
+	put32(header, LocalHeaderSignature);
+	put16(header, ZipVersion);
+	put16(header, entry.flags);
+	put16(header, static_cast<quint16>(entry.method));
+	put16(header, m_dosTime);
+	put16(header, m_dosDate);
+	put32(header, entry.crc);
+	put32(header, entry.compressedSize);
+	put32(header, entry.size);
+	put16(header, entry.name.size());
+	put16(header, 0); // extra field length
+	header.append(entry.name);
+
+	writeRaw(header.constData(), header.size());
+}
+
+void ZipWriter::writeRaw(const char *data, qint64 size)
+{
+	m_out.write(data, size);
+	m_offset += size;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <QtCore>
+#include <zlib.h>
+
+#include "Output/Sink.hpp"
+
+/*
+ * Minimal streaming ZIP writer, sufficient for ODF packages: entries are
+ * either stored or deflated, and the archive is written strictly front to
+ * back, so the underlying sink never has to seek.
+ */
+class ZipWriter {
+public:
+	enum class Method : quint16 {
+		Stored = 0,
+		Deflated = 8,
+	};
+
+	explicit ZipWriter(Sink &out, int level = Z_DEFAULT_COMPRESSION, int threads = 1);
+
+	void addFile(const QByteArray &name, const char *data, qint64 size, Method method = Method::Deflated);
+	void addFile(const QByteArray &name, const QByteArray &data, Method method = Method::Deflated);
+
+	/*
+	 * Opens a deflated entry whose contents are streamed through the returned
+	 * sink, compressed on up to `threads` threads. Only one entry may be open
+	 * at a time; it is closed by finish().
+	 */
+	std::unique_ptr <Sink> openFile(const QByteArray &name);
+
+	bool finish();
+
+private:
+	friend class ZipEntrySink;
+
+	struct Entry {
+		QByteArray name;
+		Method method;
+		quint16 flags;
+		quint32 crc;
+		quint32 compressedSize;
+		quint32 size;
+		quint32 offset;
+	};
+
+	void writeLocalHeader(const Entry &entry);
+	void writeRaw(const char *data, qint64 size);
+
+	Sink &m_out;
+	int m_level;
+	int m_threads;
+	quint16 m_dosTime;
+	quint16 m_dosDate;
+	quint32 m_offset = 0;
+	bool m_entryOpen = false;
+	bool m_failed = false;
+	QVector <Entry> m_entries;
+};
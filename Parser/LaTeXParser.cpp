@@ -1,12 +1,22 @@
 #include <cassert>
+#include <cstring>
 
+#include "AllocStats.hpp"
+#include "AsyncIO.hpp"
+#include "Budget.hpp"
+#include "Depends.hpp"
+#include "Diagnostics.hpp"
 #include "Fold.hpp"
+#include "Keywords.hpp"
 #include "Markup/Cpp.hpp"
 #include "Parser/LaTeXParser.hpp"
+#include "Stats.hpp"
+#include "Tasks.hpp"
+#include "XmlGen.hpp"
 
 namespace {
 
-const Vector <QChar> SpecialChars {
+const Vector <char> SpecialChars {
 	'\'',
 	'{',
 	'}',
@@ -19,42 +29,122 @@ const Vector <QChar> SpecialChars {
 	'^',
 };
 
-inline QString generateBegin(const QString &s)
+const QByteArray IncludeGraphicsOptions = QByteArray{Strings::IncludeGraphics} + '[';
+
+inline bool isSpace(char c)
 {
-	if (Environment.contains(s))
-		return QString{"\\%1{%2}"}.arg(Strings::Begin).arg(s);
-	if (Fragment.contains(s))
-		return QString{"\\%1{"}.arg(s);
-	if (Tag.contains(s))
-		return QString{"\\%1"}.arg(s);
+	return any_of(c, ' ', '\t', '\n', '\r', '\f', '\v');
+}
 
-	qCritical() << "generateBegin() - unknown element:" << s;
-	std::exit(1);
-	return QString{};
+std::optional <QByteArray> readFile(const QString &filename)
+{
+	QFile file{filename};
+	if (!file.open(QIODevice::ReadOnly)) {
+		Depends::recordAbsent(filename);
+		return {};
+	}
+	QByteArray data = file.readAll();
+	Depends::record(filename, data);
+	return data;
 }
 
-inline QString generateEnd(const QString &s)
+/*
+ * Points the image and object frames in the subtree to their new names.
+ */
+void renameFrames(Node &node, const QHash <QByteArray, QByteArray> &hrefs)
 {
-	if (Environment.contains(s))
-		return QString{"%1{%2}"}.arg(Strings::End).arg(s);
-	if (Fragment.contains(s))
-		return QString{"}"};
+	static const QByteArray Attribute = "xlink:href=\"";
+	if (node.type == Node::Type::Text && node.value.contains(Attribute)) {
+		QByteArray result;
+		int from = 0;
+		for (int idx = node.value.indexOf(Attribute); idx != -1; idx = node.value.indexOf(Attribute, from)) {
+			idx += Attribute.size();
+			const int end = node.value.indexOf('"', idx);
+			if (end == -1)
+				break;
+			const QByteArray href = node.value.mid(idx, end - idx);
+			result += node.value.mid(from, idx - from);
+			result += hrefs.value(href, href);
+			from = end;
+		}
+		result += node.value.mid(from);
+		node.value = std::move(result);
+	}
 
-	if (!Tag.contains(s)) {
-		qCritical() << "generateEnd() - unknown element:" << s;
-		std::exit(1);
+	for (Node &child : node.children)
+		renameFrames(child, hrefs);
+}
+
+QList <QByteArray> splitParagraphs(const QByteArray &text)
+{
+	QList <QByteArray> result;
+	int start = 0;
+	for (int end; (end = text.indexOf("\n\n", start)) != -1; start = end + 2)
+		result.append(text.mid(start, end - start));
+	result.append(text.mid(start));
+	return result;
+}
+
+inline QByteArray generateBegin(const QByteArray &s)
+{
+	const quint8 flags = Keywords::find(s).flags;
+	if (flags & Keywords::Environment)
+		return QByteArray{"\\"} + Strings::Begin + '{' + s + '}';
+	if (flags & Keywords::Fragment)
+		return '\\' + s + '{';
+	if (flags & Keywords::Tag)
+		return '\\' + s;
+
+	Diagnostics::error(QString{"generateBegin() - unknown element: %1"}.arg(QString::fromUtf8(s)));
+	return QByteArray{};
+}
+
+inline QByteArray generateEnd(const QByteArray &s)
+{
+	const quint8 flags = Keywords::find(s).flags;
+	if (flags & Keywords::Environment)
+		return QByteArray{Strings::End} + '{' + s + '}';
+	if (flags & Keywords::Fragment)
+		return QByteArray{"}"};
+
+	if (!(flags & Keywords::Tag))
+		Diagnostics::error(QString{"generateEnd() - unknown element: %1"}.arg(QString::fromUtf8(s)));
+
+	return QByteArray{};
+}
+
+/*
+ * \newcommand and \renewcommand, either with a star: the star only tells
+ * that arguments span no paragraphs, and macros take no arguments.
+ */
+inline bool isDefinition(QByteArray token)
+{
+	if (token.endsWith('*'))
+		token.chop(1);
+	return token == Strings::NewCommand || token == Strings::RenewCommand;
+}
+
+/* Whether `idx` lies in a comment or a verbatim environment */
+bool isIgnored(const QByteArray &data, int idx)
+{
+	for (int i = data.lastIndexOf('\n', idx) + 1; i < idx; ++i) {
+		if (data[i] == '\\')
+			++i;
+		else if (data[i] == '%')
+			return true;
 	}
 
-	return QString{};
+	const int begin = data.lastIndexOf(generateBegin(Strings::Verbatim), idx);
+	return begin != -1 && data.lastIndexOf('\\' + generateEnd(Strings::Verbatim), idx) < begin;
 }
 
 }
 
-void LaTeXParser::ParseContext::reset(QString data)
+void LaTeXParser::ParseContext::reset(QByteArray data)
 {
 	this->data = data;
+	index.build(this->data);
 	inCode = false;
-	inMathMode = false;
 	idx = 0;
 	braceCnt = 0;
 }
@@ -64,13 +154,13 @@ bool LaTeXParser::ParseContext::eof() const
 	return idx == data.size();
 }
 
-QChar LaTeXParser::ParseContext::previous() const
+char LaTeXParser::ParseContext::previous() const
 {
 	assert(idx > 0);
 	return data[idx - 1];
 }
 
-QChar LaTeXParser::ParseContext::current() const
+char LaTeXParser::ParseContext::current() const
 {
 	return data[idx];
 }
@@ -80,7 +170,12 @@ void LaTeXParser::ParseContext::advance(int steps)
 	idx += steps;
 }
 
-bool LaTeXParser::ParseContext::advanceUntil(QChar c)
+bool LaTeXParser::ParseContext::lookingAt(const QByteArray &text) const
+{
+	return idx + text.size() <= data.size() && std::memcmp(data.constData() + idx, text.constData(), text.size()) == 0;
+}
+
+bool LaTeXParser::ParseContext::advanceUntil(char c)
 {
 	while (!eof()) {
 		if (current() == c)
@@ -91,28 +186,35 @@ bool LaTeXParser::ParseContext::advanceUntil(QChar c)
 	return false;
 }
 
-QString LaTeXParser::ParseContext::getToken()
+int LaTeXParser::ParseContext::nextStructural() const
+{
+	return index.next(idx);
+}
+
+QByteArray LaTeXParser::ParseContext::getToken()
 {
-	auto endSymbol = [](QChar c){
-		return c.isSpace() || SpecialChars.contains(c);
+	ALLOC_PHASE("tokenize");
+	auto endSymbol = [](char c){
+		return isSpace(c) || SpecialChars.contains(c);
 	};
 
-	if (endSymbol(current())) {
-		advance();
-		return QString{previous()};
+	if (eof()) {
+		Diagnostics::error("EOF with empty token");
+		return QByteArray{};
 	}
 
-	if (eof()) {
-		qCritical() << "EOF with empty token";
-		std::exit(1);
+	if (endSymbol(current())) {
+		advance();
+		return QByteArray::fromRawData(data.constData() + idx - 1, 1);
 	}
 
-	QString token;
+	const int start = idx;
 	do {
-		token += current();
 		advance();
 	} while (!eof() && !endSymbol(current()));
 
+	const QByteArray token = QByteArray::fromRawData(data.constData() + start, idx - start);
+
 	if (eof()) {
 		qInfo() << "EOF reached in getToken()";
 		return token;
@@ -124,53 +226,442 @@ QString LaTeXParser::ParseContext::getToken()
 	return token;
 }
 
-std::optional <Document> LaTeXParser::doParse(const QString &data)
+bool LaTeXParser::loadMacros(const QString &filename)
+{
+	QFile macroFile{filename};
+	if (!macroFile.open(QIODevice::ReadOnly)) {
+		Diagnostics::error(QString{"unable to open macro file: %1"}.arg(filename));
+		return false;
+	}
+	QByteArray data = macroFile.readAll();
+	Depends::record(filename, data);
+
+	ParseContext prevCtx = std::move(parseCtx);
+	parseCtx.reset(std::move(data));
+	const bool result = scanMacros(-1);
+	parseCtx = std::move(prevCtx);
+	return result;
+}
+
+std::optional <Document> LaTeXParser::doParse(const QByteArray &data)
 {
 	Document result;
 	parseCtx.reset(data);
-	if (!extract(result.title, Strings::Title) || !extract(result.documentRoot, Strings::Document))
+	if (!scanMacros(data.indexOf(generateBegin(Strings::Document))))
 		return {};
+
+	prefetch();
+
+	parseCtx.idx = 0;
+	if (!extract(result.title, Strings::Title))
+		return {};
+	streamTitle(result.title);
+
+	beginStream(result.documentRoot);
+	if (!extract(result.documentRoot, Strings::Document))
+		return {};
+	endStream(result.documentRoot);
+
+	// files prefetched but never used are waited for, their forks run in the scopes of this conversion
+	for (auto &include : includes)
+		include.second.wait();
+	includes.clear();
+	sources.clear();
+	readers.clear();
+	result.images = std::move(*images);
+	result.formulas = std::move(*formulas);
 	return std::move(result);
 }
 
-bool LaTeXParser::extract(Node &root, const QString &token)
+bool LaTeXParser::defineMacro()
 {
-	const QString Pattern = generateBegin(token);
+	if (!parseCtx.advanceUntil('\\')) {
+		Diagnostics::error(QString{"%1: expected macro name"}.arg(Strings::NewCommand));
+		return false;
+	}
+	parseCtx.advance();
+	const QByteArray name = parseCtx.getToken();
+	if (name.isEmpty())
+		return false;
+
+	if (name == Strings::Begin || name == Strings::End || isDefinition(name)) {
+		Diagnostics::error(QString{"%1: '%2' cannot be redefined"}.arg(Strings::NewCommand).arg(name));
+		return false;
+	}
+	if (Keywords::find(name).id != Keywords::NotFound)
+		Diagnostics::warning(QString{"%1: macro '%2' replaces the built-in command"}.arg(Strings::NewCommand).arg(name));
+
+	if (parseCtx.previous() != '{') {
+		while (!parseCtx.eof() && isSpace(parseCtx.current()))
+			parseCtx.advance();
+
+		if (!parseCtx.eof() && parseCtx.current() == '[') {
+			Diagnostics::error(QString{"%1: arguments of macro '%2' are not supported"}.arg(Strings::NewCommand).arg(name));
+			return false;
+		}
+
+		if (parseCtx.eof() || parseCtx.current() != '{') {
+			Diagnostics::error(QString{"%1: expected body of macro '%2'"}.arg(Strings::NewCommand).arg(name));
+			return false;
+		}
+		parseCtx.advance();
+	}
+
+	const bool inCode = parseCtx.inCode;
+	const int braceCnt = parseCtx.braceCnt;
+	parseCtx.inCode = false;
+	parseCtx.braceCnt = 0;
+
+	// the name outlives the source it points into
+	const QByteArray macroName{name.constData(), name.size()};
+	Node body{Node::Type::Fragment, QByteArray{macroName}};
+	const bool result = parseSource(body, "}");
+
+	parseCtx.inCode = inCode;
+	parseCtx.braceCnt = braceCnt;
+
+	if (!result)
+		return false;
+
+	auto iter = macroIndex.constFind(name);
+	if (iter == macroIndex.constEnd()) {
+		macroIndex.insert(macroName, macros.count());
+		macros.push_back(std::move(body));
+	} else {
+		macros[*iter] = std::move(body);
+	}
+
+	return true;
+}
+
+bool LaTeXParser::scanMacros(int endIdx)
+{
+	const QByteArray Pattern = Strings::NewCommand;
+	while (true) {
+		parseCtx.idx = parseCtx.data.indexOf(Pattern, parseCtx.idx);
+		if (parseCtx.idx == -1 || (endIdx != -1 && parseCtx.idx > endIdx))
+			return true;
+
+		// \newcommand or \renewcommand, not a word merely ending in "newcommand"
+		const int start = parseCtx.idx;
+		parseCtx.advance(Pattern.length());
+		const bool command = (start >= 1 && parseCtx.data[start - 1] == '\\')
+			|| (start >= 3 && std::memcmp(parseCtx.data.constData() + start - 3, "\\re", 3) == 0);
+		if (!command || isIgnored(parseCtx.data, start))
+			continue;
+
+		if (!parseCtx.eof() && parseCtx.current() == '*')
+			parseCtx.advance();
+		if (!defineMacro())
+			return false;
+	}
+}
+
+const Node * LaTeXParser::findMacro(const QByteArray &name) const
+{
+	auto iter = macroIndex.constFind(name);
+	if (iter == macroIndex.constEnd())
+		return nullptr;
+	return &macros[*iter];
+}
+
+bool LaTeXParser::includeGraphics(Node &node)
+{
+	QByteArray options;
+	if (parseCtx.previous() != '{') {
+		if (!parseCtx.eof() && parseCtx.current() == '[') {
+			const int start = parseCtx.idx + 1;
+			if (!parseCtx.advanceUntil(']')) {
+				Diagnostics::error(QString{"%1: unterminated options"}.arg(Strings::IncludeGraphics));
+				return false;
+			}
+			options = parseCtx.data.mid(start, parseCtx.idx - start);
+			parseCtx.advance();
+		}
+
+		if (parseCtx.eof() || parseCtx.current() != '{') {
+			Diagnostics::error(QString{"%1: expected file name"}.arg(Strings::IncludeGraphics));
+			return false;
+		}
+		parseCtx.advance();
+	}
+
+	const int start = parseCtx.idx;
+	if (!parseCtx.advanceUntil('}')) {
+		Diagnostics::error(QString{"%1: unterminated file name"}.arg(Strings::IncludeGraphics));
+		return false;
+	}
+	const QByteArray filename = parseCtx.data.mid(start, parseCtx.idx - start).trimmed();
+	parseCtx.advance();
+
+	const std::optional <Image> image = images->add(path(filename));
+	if (!image)
+		return false;
+
+	node.appendNode(Node::Type::Text, imageFrame(*image, options));
+	return true;
+}
+
+void LaTeXParser::prefetch()
+{
+	auto scan = [this](const QByteArray &command, auto start) {
+		const QByteArray Pattern = '\\' + command + '{';
+		for (int idx = parseCtx.data.indexOf(Pattern); idx != -1; idx = parseCtx.data.indexOf(Pattern, idx)) {
+			idx += Pattern.size();
+			const int end = parseCtx.data.indexOf('}', idx);
+			if (end == -1)
+				return;
+			start(parseCtx.data.mid(idx, end - idx).trimmed());
+		}
+	};
+
+	auto include = [this](const QByteArray &name){
+		if (includes.count(name) != 0)
+			return;
+		if (!includePool) {
+			includePool = std::make_unique<QThreadPool>();
+			includePool->setMaxThreadCount(QThread::idealThreadCount());
+		}
+		includes.emplace(name, runTask(*includePool, [parser = fork(), name, budget = Budget::current(), depends = Depends::current(), diagnostics = Diagnostics::current(), stats = Stats::current()](){
+			Budget::Scope scope{budget};
+			Depends::Scope dependsScope{depends};
+			Diagnostics::Scope diagnosticsScope{diagnostics};
+			Stats::Scope statsScope{stats};
+			return parser->parseFile(name);
+		}));
+	};
+	// only the document itself parses ahead, see `includes`
+	if (includeChain.isEmpty()) {
+		scan(Strings::Input, include);
+		scan(Strings::Include, include);
+	}
+
+	// all source files found are read in one batch
+	QList <QByteArray> names;
+	QStringList paths;
+	scan(Strings::SourceCode, [this, &names, &paths](const QByteArray &name){
+		if (sources.count(name) == 0 && !names.contains(name) && !draft()) {
+			names.append(name);
+			paths.append(path(name + ".tex"));
+		}
+	});
+	if (names.isEmpty())
+		return;
+
+	ReadBatch batch = readFiles(paths);
+	for (int i = 0; i < names.count(); ++i)
+		sources.emplace(names[i], std::move(batch.files[i]));
+	readers.push_back(std::move(batch.done));
+}
+
+/*
+ * The formulas of a document and of all its included files are turned into
+ * MathML on one pool, owned by the parsers of this conversion only.
+ */
+std::shared_ptr <QThreadPool> LaTeXParser::makeFormulaPool()
+{
+	auto result = std::make_shared<QThreadPool>();
+	result->setMaxThreadCount(QThread::idealThreadCount());
+	return result;
+}
+
+std::unique_ptr <LaTeXParser> LaTeXParser::fork() const
+{
+	auto result = std::make_unique<LaTeXParser>();
+	result->macroIndex = macroIndex;
+	result->macros.reserve(macros.count());
+	for (const Node &macro : macros)
+		result->macros.push_back(macro.clone());
+	result->includeChain = includeChain;
+	result->formulaPool = formulaPool;
+	result->setDraft(draft());
+	result->setBaseDir(baseDir());
+	return result;
+}
+
+LaTeXParser::Include LaTeXParser::parseFile(const QByteArray &name)
+{
+	Include result;
+	QString filename = path(name);
+	if (QFileInfo{filename}.suffix().isEmpty())
+		filename += ".tex";
+
+	const QString canonical = QFileInfo{filename}.canonicalFilePath();
+	if (canonical.isEmpty()) {
+		Depends::recordAbsent(filename);
+		result.error = QString{"%1: file not found: %2"}.arg(Strings::Input).arg(filename);
+		return result;
+	}
+	if (includeChain.contains(canonical)) {
+		result.error = QString{"%1: %2 includes itself"}.arg(Strings::Input).arg(filename);
+		return result;
+	}
+
+	std::optional <QByteArray> data = readFile(canonical);
+	if (!data) {
+		result.error = QString{"%1: unable to open: %2"}.arg(Strings::Input).arg(filename);
+		return result;
+	}
+
+	includeChain.append(canonical);
+	parseCtx.reset(std::move(*data));
+	prefetch();
+
+	Node root{Node::Type::Fragment, Strings::Input};
+	result.ok = parseSource(root, QByteArray{});
+	if (!result.ok)
+		result.error = QString{"%1: unable to parse %2"}.arg(Strings::Input).arg(filename);
+	result.nodes = std::move(root.children);
+	result.images = std::move(*images);
+	result.formulas = std::move(*formulas);
+	return result;
+}
+
+bool LaTeXParser::input(Node &node)
+{
+	if (parseCtx.previous() != '{') {
+		while (!parseCtx.eof() && isSpace(parseCtx.current()))
+			parseCtx.advance();
+
+		if (parseCtx.eof() || parseCtx.current() != '{') {
+			Diagnostics::error(QString{"%1: expected file name"}.arg(Strings::Input));
+			return false;
+		}
+		parseCtx.advance();
+	}
+
+	const int start = parseCtx.idx;
+	if (!parseCtx.advanceUntil('}')) {
+		Diagnostics::error(QString{"%1: unterminated file name"}.arg(Strings::Input));
+		return false;
+	}
+	const QByteArray name = parseCtx.data.mid(start, parseCtx.idx - start).trimmed();
+	parseCtx.advance();
+
+	Include include;
+	auto iter = includes.find(name);
+	if (iter != includes.end()) {
+		include = iter->second.get();
+		includes.erase(iter);
+	} else {
+		include = fork()->parseFile(name);
+	}
+
+	if (!include.ok) {
+		Diagnostics::error(include.error);
+		return false;
+	}
+
+	QHash <QByteArray, QByteArray> hrefs;
+	for (const Image &image : include.images.all()) {
+		const QString href = images->adopt(image).href;
+		if (href != image.href)
+			hrefs.insert(image.href.toUtf8(), href.toUtf8());
+	}
+	for (const Formula &formula : include.formulas.all()) {
+		const QString href = formulas->adopt(formula).href;
+		if (href != formula.href)
+			hrefs.insert("./" + formula.href.toUtf8(), "./" + href.toUtf8());
+	}
+
+	node.children.reserveMore(include.nodes.count());
+	for (Node &child : include.nodes) {
+		if (!hrefs.isEmpty())
+			renameFrames(child, hrefs);
+		node.children.push_back(std::move(child));
+	}
+	return true;
+}
+
+std::optional <QByteArray> LaTeXParser::source(const QByteArray &name)
+{
+	auto iter = sources.find(name);
+	if (iter == sources.end())
+		return readFile(path(name + ".tex"));
+
+	std::optional <QByteArray> result = iter->second.get();
+	sources.erase(iter);
+	if (result)
+		Depends::record(path(name + ".tex"), *result);
+	else
+		Depends::recordAbsent(path(name + ".tex"));
+	return result;
+}
+
+/*
+ * The math between the opening delimiter, already consumed, and `closing`
+ * becomes an embedded formula object. An escaped character, such as \$,
+ * never closes the formula.
+ */
+bool LaTeXParser::addFormula(Node &node, const QByteArray &closing, bool display)
+{
+	const int start = parseCtx.idx;
+	while (!parseCtx.eof() && !parseCtx.lookingAt(closing)) {
+		if (parseCtx.current() == '\\' && parseCtx.idx + 1 < parseCtx.data.size())
+			parseCtx.advance();
+		parseCtx.advance();
+	}
+	if (parseCtx.eof()) {
+		Diagnostics::error(QString{"unterminated math, expected %1"}.arg(QString::fromUtf8(closing)));
+		return false;
+	}
+	const int end = parseCtx.idx;
+	parseCtx.advance(closing.size());
+
+	const Formula formula = formulas->add(parseCtx.data.mid(start, end - start), display, *formulaPool);
+	Node &child = node.appendNode(Node::Type::Text, formulaFrame(formula));
+	child.endParagraph = display;
+	return true;
+}
+
+bool LaTeXParser::extract(Node &root, const QByteArray &token)
+{
+	const QByteArray Pattern = generateBegin(token);
+	if (Pattern.isEmpty())
+		return false;
 	parseCtx.idx = parseCtx.data.indexOf(Pattern, parseCtx.idx);
 	if (parseCtx.idx == -1) {
-		qWarning() << QString{"extract: pattern '%1' not found"}.arg(Pattern);
+		Diagnostics::warning(QString{"extract: pattern '%1' not found"}.arg(Pattern));
 		return false;
 	}
 	parseCtx.advance(Pattern.length());
 
-	root = Node{Node::typeFromName(token), QString{token}};
+	root = Node{Node::typeFromName(token), QByteArray{token}};
+	if (root.type == Node::Type::Invalid)
+		return false;
 	return parseSource(root, generateEnd(token));
 }
 
-bool LaTeXParser::parseSource(Node &node, const QString &endMarker)
+bool LaTeXParser::parseSource(Node &node, const QByteArray &endMarker)
 {
-	QString content;
+	const Budget::Nesting nesting;
+	if (!nesting.ok())
+		return false;
+
+	QByteArray content;
 
 	auto addText = [this, &content, &node](bool paragraph = false) {
+		ALLOC_SITE("LaTeXParser::addText");
 		if (!parseCtx.inCode && content.trimmed().isEmpty() && paragraph == false) {
 			content.clear();
 			return;
 		}
 		content.replace('~', Unicode::NonBreakingSpace);
 
-		if (!parseCtx.inCode) {
+		if (!parseCtx.inCode && !draft()) {
 			content.replace("---", "–");
 			content.replace("--", "–");
 		}
 		addEntities(content);
 
-		QStringList contentList = content.split("\n\n");
+		QList <QByteArray> contentList = splitParagraphs(content);
 
 		if (parseCtx.inCode) {
-			for (QString &s : contentList)
-				s = s.remove('\n');
+			for (QByteArray &s : contentList)
+				s.replace("\n", "");
 		}
 
+		node.children.reserveMore(contentList.count());
 		for (int i = 0; i < contentList.count() - 1; ++i) {
 			Node &child = node.appendNode(Node::Type::Text, contentList[i].replace('\n', ' '));
 			child.endParagraph = true;
@@ -182,6 +673,10 @@ bool LaTeXParser::parseSource(Node &node, const QString &endMarker)
 	};
 
 	while (!parseCtx.eof()) {
+		if (!Budget::check())
+			return false;
+		flush(node);
+
 		if (parseCtx.current() == '}') {
 			if (parseCtx.braceCnt != 0) {
 				--parseCtx.braceCnt;
@@ -191,33 +686,62 @@ bool LaTeXParser::parseSource(Node &node, const QString &endMarker)
 				parseCtx.advance();
 				return true;
 			} else {
-				qCritical() << QString{"unexpected closing brace"};
+				Diagnostics::error(QString{"unexpected closing brace"});
 				return false;
 			}
 		} else if (parseCtx.current() == '\\') {
 			parseCtx.advance();
-			QString token = parseCtx.getToken();
-			qDebug() << "token = " << token;
-			qDebug() << QString{"data[idx] = %1, braceCnt = %2"}.arg(parseCtx.current()).arg(parseCtx.braceCnt);
-			if (SpecialChars.contains(token[0]) || token[0].isSpace()) {
+			if (!parseCtx.eof() && parseCtx.current() == '[' && !parseCtx.inCode) {
+				addText(true);
+				parseCtx.advance();
+				if (!addFormula(node, "\\]", true))
+					return false;
+				continue;
+			}
+			if (parseCtx.lookingAt(IncludeGraphicsOptions)) {
+				// '[' ends no other token, so the options are split off here
+				addText();
+				parseCtx.advance(qstrlen(Strings::IncludeGraphics));
+				if (!includeGraphics(node))
+					return false;
+				continue;
+			}
+			QByteArray token = parseCtx.getToken();
+			if (token.isEmpty())
+				return false;
+			const Keywords::Match keyword = Keywords::find(token);
+			if (SpecialChars.contains(token[0]) || isSpace(token[0])) {
 				if (token[0] == '\\') {
 					addText(true);
 				} else if (token[0] != '\n') {
 					content += token;
 				}
-			} else if (Tag.contains(token)) {
+			} else if (const Node *macro = findMacro(token)) {
+				// defined by the document, so it takes precedence over a built-in of the same name
+				addText();
+				node.children.reserveMore(macro->children.count());
+				for (const Node &child : macro->children)
+					node.children.push_back(child.clone());
+
+				if (any_of(parseCtx.previous(), ' ', '{', '}'))
+					parseCtx.advance(-1);
+			} else if (keyword.flags & Keywords::Tag) {
 				addText();
 				if (token == Strings::Quote) {
 					content += '"';
 				} else if (token == Strings::Backslash || token == Strings::TextBackslash) {
 					content += '\\';
 				} else {
-					node.appendNode(Node::Type::Tag, token);
+					node.appendNode(Node::Type::Tag, Keywords::name(keyword.id));
 				}
 
 				if (any_of(parseCtx.previous(), ' ', '{', '}'))
 					parseCtx.advance(-1);
-			} else if (Fragment.contains(token)) {
+			} else if (token == Strings::Input || token == Strings::Include) {
+				addText();
+				if (!input(node))
+					return false;
+			} else if (keyword.flags & Keywords::Fragment) {
 				if (parseCtx.current() == '}') {
 					parseCtx.advance();
 					if (token == "mbox" && parseCtx.inCode && parseCtx.current() == '\n')
@@ -233,36 +757,45 @@ bool LaTeXParser::parseSource(Node &node, const QString &endMarker)
 				}
 
 				addText();
-				Node &child = node.appendNode(Node::Type::Fragment, token);
+				Node &child = node.appendNode(Node::Type::Fragment, Keywords::name(keyword.id));
 				parseSource(child, "}");
 				if (token == Strings::SourceCode) {
 					if (child.children.count() != 1) {
-						qCritical() << QString{"sourcecodefile node has %1 descendants, expected 1"}.arg(node.children.count());
+						Diagnostics::error(QString{"sourcecodefile node has %1 descendants, expected 1"}.arg(node.children.count()));
 						return false;
 					}
-					const QString &filename = child.children.front().value + ".tex";
-					QFile sourceFile{filename};
-					if (!sourceFile.open(QIODevice::ReadOnly)) {
-						qCritical() << QString{"unable to open sourcecodefile: %1"}.arg(filename);
+					const QByteArray name = child.children.front().value;
+					// the draft shows the source file itself, when it is next to its highlighted .tex
+					const std::optional <QByteArray> plain = draft() ? readFile(path(name)) : std::nullopt;
+					if (plain) {
+						node.appendNode(Node::Type::Tag, Strings::CodeStart);
+						addPlainCode(node, plain->split('\n'));
+						node.appendNode(Node::Type::Tag, Strings::CodeEnd);
+						continue;
+					}
+
+					std::optional <QByteArray> data = source(name);
+					if (!data) {
+						Diagnostics::error(QString{"unable to open sourcecodefile: %1.tex"}.arg(QString::fromUtf8(name)));
 						return false;
 					}
 
-					QTextStream sourceStream{&sourceFile};
 					ParseContext prevCtx = std::move(parseCtx);
-					parseCtx.reset(sourceStream.readAll());
+					parseCtx.reset(std::move(*data));
 					parseCtx.inCode = true;
 
 					node.appendNode(Node::Type::Tag, Strings::CodeStart);
-					parseSource(node, QString{});
+					parseSource(node, QByteArray{});
 					node.appendNode(Node::Type::Tag, Strings::CodeEnd);
 					parseCtx = std::move(prevCtx);
 				}
 			} else if (token == Strings::Begin || token == Strings::End) {
 				addText();
 				const bool isBegin = (token == Strings::Begin);
-				const QString envName = parseCtx.getToken();
-				if (!Environment.contains(envName)) {
-					qCritical() << QString{"Unknown environment: %1"}.arg(envName);
+				const QByteArray envName = parseCtx.getToken();
+				const Keywords::Match environment = Keywords::find(envName);
+				if (!(environment.flags & Keywords::Environment)) {
+					Diagnostics::error(QString{"Unknown environment: %1"}.arg(envName));
 					return false;
 				}
 
@@ -272,53 +805,53 @@ bool LaTeXParser::parseSource(Node &node, const QString &endMarker)
 				}
 
 				if (isBegin) {
-					Node &child = node.appendNode(Node::Type::Environment, envName);
+					Node &child = node.appendNode(Node::Type::Environment, Keywords::name(environment.id));
 					if (!parseSource(child, generateEnd(envName)))
 						return false;
 				} else {
-					token = QString{"%1{%2}"}.arg(token).arg(envName);
+					token += '{' + envName + '}';
 					if (token != endMarker) {
-						qCritical() << QString{"Expected endMarker %1, got %2"}.arg(endMarker).arg(token);
+						Diagnostics::error(QString{"Expected endMarker %1, got %2"}.arg(endMarker).arg(token));
 						return false;
 					}
 					return true;
 				}
-			} else {
-				const QString &text = Cpp::markup(token);
-				if (text.isEmpty()) {
-					qCritical() << QString{"Unhandled token: %1"}.arg(token);
-					return false;
-				}
-
+			} else if (keyword.flags & Keywords::Markup) {
 				addText();
-				node.appendNode(Node::Type::Text, text);
+				node.appendNode(Node::Type::Text, Cpp::markup(keyword.id));
 
 				if (parseCtx.current() == '}')
 					parseCtx.advance();
+			} else if (token == Strings::IncludeGraphics) {
+				addText();
+				if (!includeGraphics(node))
+					return false;
+			} else if (isDefinition(token)) {
+				addText();
+				if (!defineMacro())
+					return false;
+			} else {
+				Diagnostics::error(QString{"Unhandled token: %1"}.arg(token));
+				return false;
 			}
+		} else if (!parseCtx.inCode && !StructuralIndex::isStructural(parseCtx.current())) {
+			// prose: everything up to the next structural byte is plain text
+			const int end = parseCtx.nextStructural();
+			content.append(parseCtx.data.constData() + parseCtx.idx, end - parseCtx.idx);
+			parseCtx.idx = end;
 		} else {
-			switch (parseCtx.current().toLatin1()) {
+			switch (parseCtx.current()) {
 				case '{':
 					++parseCtx.braceCnt;
 					break;
 				case '$':
-					if (!parseCtx.inCode)
-						parseCtx.inMathMode = !parseCtx.inMathMode;
-					break;
-				case '^':
-					if (parseCtx.inMathMode) {
-						addText();
-						parseCtx.advance();
-						Node &child = node.appendNode(Node::Type::Fragment, Strings::Superscript);
-						if (parseCtx.current() == '{') {
-							parseCtx.advance();
-							parseSource(child, "}");
-							parseCtx.advance(-1);
-						} else {
-							child.appendNode(Node::Type::Text, parseCtx.current());
-						}
-					} else {
-						content += parseCtx.current();
+					if (!parseCtx.inCode) {
+						const bool display = (parseCtx.idx + 1 < parseCtx.data.size() && parseCtx.data[parseCtx.idx + 1] == '$');
+						addText(display);
+						parseCtx.advance(display ? 2 : 1);
+						if (!addFormula(node, display ? "$$" : "$", display))
+							return false;
+						continue;
 					}
 					break;
 				case ' ':
@@ -332,5 +865,8 @@ bool LaTeXParser::parseSource(Node &node, const QString &endMarker)
 		}
 	}
 
+	// only an included file ends without an end marker
+	if (!parseCtx.inCode)
+		addText();
 	return true;
 }
@@ -1,33 +1,89 @@
 #pragma once
 
+#include <future>
+#include <map>
+#include <memory>
+
 #include "Parser/Parser.hpp"
+#include "Parser/StructuralIndex.hpp"
 
 class LaTeXParser : public Parser {
 public:
-	static std::optional <Document> parse(const QString &data);
+	static std::optional <Document> parse(const QByteArray &data);
+
+	bool loadMacros(const QString &filename);
 
 private:
-	std::optional <Document> doParse(const QString &data) override;
+	std::optional <Document> doParse(const QByteArray &data) override;
 
 	struct ParseContext {
 		ParseContext() = default;
 		ParseContext(ParseContext &&) = default;
 		ParseContext & operator = (ParseContext &&) = default;
 
-		QString data;
+		QByteArray data;
+		StructuralIndex index;
 		bool inCode = false;
-		bool inMathMode = false;
 		int idx = 0, braceCnt = 0;
 
-		void reset(QString data = QString{});
+		void reset(QByteArray data = QByteArray{});
 		bool eof() const;
-		QChar current() const;
-		QChar previous() const;
+		char current() const;
+		char previous() const;
 		void advance(int steps = 1);
-		bool advanceUntil(QChar c);
-		QString getToken();
+		bool lookingAt(const QByteArray &text) const;
+		bool advanceUntil(char c);
+		int nextStructural() const;
+		/* Points into `data` without a copy; a token that is kept must be copied. */
+		QByteArray getToken();
 	} parseCtx;
 
-	bool extract(Node &root, const QString &token);
-	bool parseSource(Node &node, const QString &endMarker);
+	/*
+	 * User macros, compiled once into a node list at definition time;
+	 * an expansion is a single hash lookup followed by a subtree copy.
+	 */
+	QHash <QByteArray, int> macroIndex;
+	Vector <Node> macros;
+	std::shared_ptr <Images> images = std::make_shared<Images>();
+	std::shared_ptr <Formulas> formulas = std::make_shared<Formulas>();
+	std::shared_ptr <QThreadPool> formulaPool = makeFormulaPool(); // shared with the forks
+
+	bool defineMacro();
+	bool scanMacros(int endIdx);
+	const Node * findMacro(const QByteArray &name) const;
+	bool includeGraphics(Node &node);
+	bool addFormula(Node &node, const QByteArray &closing, bool display);
+	static std::shared_ptr <QThreadPool> makeFormulaPool();
+
+	struct Include {
+		bool ok = false;
+		QString error;
+		Vector <Node> nodes;
+		Images images; // numbered by the fork, renumbered when grafted
+		Formulas formulas; // same
+	};
+
+	/*
+	 * The files named by \input, \include and \sourcecodefile are found by a
+	 * scan of the whole source before parsing starts and loaded concurrently.
+	 * Every file the document includes is parsed by a fork of this parser on
+	 * a pool of one thread per core, and the resulting nodes are grafted where
+	 * the \input stands. A fork parses the files it includes itself, in place,
+	 * so no pool thread ever waits for another. The images and formulas of a
+	 * fork join the numbering of the document when grafted, in document order.
+	 */
+	std::unique_ptr <QThreadPool> includePool;
+	std::map <QByteArray, std::future <Include> > includes;
+	std::map <QByteArray, std::future <std::optional <QByteArray> > > sources;
+	std::vector <std::future <void> > readers; // of the batches filling `sources`
+	QStringList includeChain; // canonical paths of the files being included
+
+	void prefetch();
+	std::unique_ptr <LaTeXParser> fork() const;
+	Include parseFile(const QByteArray &name);
+	bool input(Node &node);
+	std::optional <QByteArray> source(const QByteArray &name);
+
+	bool extract(Node &root, const QByteArray &token);
+	bool parseSource(Node &node, const QByteArray &endMarker);
 };
@@ -1,13 +1,20 @@
+#include "Budget.hpp"
+#include "Diagnostics.hpp"
+#include "Metrics.hpp"
 #include "Parser/MarkdownParser.hpp"
 
-void MarkdownParser::parseSource(const QString &data, int &idx, Node &node, const QString &endMarker)
+bool MarkdownParser::parseSource(const QByteArray &data, int &idx, Node &node, char endMarker)
 {
-	static const QHash <QChar, QString> FragmentMap {
+	static const QHash <char, const char *> FragmentMap {
 		{'*', Strings::BoldFace},
 		{'`', Strings::TextTT},
 	};
 
-	QString content;
+	const Budget::Nesting nesting;
+	if (!nesting.ok())
+		return false;
+
+	QByteArray content;
 
 	auto addText = [this, &content, &node]() {
 		if (content.isEmpty())
@@ -21,23 +28,28 @@ void MarkdownParser::parseSource(const QString &data, int &idx, Node &node, cons
 	};
 
 	while (idx != data.length()) {
-		QChar current = data[idx++];
+		if (!Budget::check())
+			return false;
+
+		char current = data[idx++];
 
-		if (endMarker == current) {
+		if (endMarker != '\0' && endMarker == current) {
 			addText();
-			return;
+			return true;
 		}
 
 		if (!parseCtx.inCode && current == '[') { //skip URLs
 			addText();
 			do {
-				ensureData(data, idx, 1);
+				if (!ensureData(data, idx, 1))
+					return false;
 				current = data[idx++];
 			} while (current != '(');
 
 			int endUrl = idx;
 			do {
-				ensureData(data, endUrl, 1);
+				if (!ensureData(data, endUrl, 1))
+					return false;
 				++endUrl;
 			} while (data[endUrl] != ')');
 
@@ -53,34 +65,44 @@ void MarkdownParser::parseSource(const QString &data, int &idx, Node &node, cons
 			Node &child = node.appendNode(Node::Type::Fragment, FragmentMap[current]);
 			if (current == '`')
 				parseCtx.inCode = true;
-			parseSource(data, idx, child, current);
+			const bool result = parseSource(data, idx, child, current);
 			if (current == '`')
 				parseCtx.inCode = false;
+			if (!result)
+				return false;
 		} else {
 			content += current;
 		}
 	}
 
 	addText();
+	return true;
 }
 
-std::optional <Document> MarkdownParser::doParse(const QString &data)
+std::optional <Document> MarkdownParser::doParse(const QByteArray &data)
 {
 	Document doc;
 	Node &root = doc.documentRoot;
+	root = Node{Node::typeFromName(Strings::Document), QByteArray{Strings::Document}};
+	beginStream(root);
 
-	QStringList lines = data.split('\n');
+	const QList <QByteArray> lines = data.split('\n');
 
 	{
 		Node &t = root.appendNode(Node::Type::Fragment, Strings::Title);
 		int idx = 1;
-		parseSource(lines[0], idx, t, QString{});
+		if (!parseSource(lines[0], idx, t, '\0'))
+			return {};
 		root.appendNode(Node::Type::Tag, Strings::MakeTitle);
 	}
 
 	int line = 1;
 	while (line != lines.count()) {
-		QString s = lines[line++];
+		if (!Budget::check())
+			return {};
+		flush(root);
+
+		QByteArray s = lines[line++];
 		if (!parseCtx.inCode && s.simplified().isEmpty())
 			continue;
 
@@ -93,7 +115,8 @@ std::optional <Document> MarkdownParser::doParse(const QString &data)
 			while (s.startsWith("-")) {
 				list.appendNode(Node::Type::Tag, Strings::Item);
 				int idx = 1;
-				parseSource(s, idx, list, QString{});
+				if (!parseSource(s, idx, list, '\0'))
+					return {};
 
 				if (line == lines.count())
 					break;
@@ -106,14 +129,14 @@ std::optional <Document> MarkdownParser::doParse(const QString &data)
 		if (s.startsWith("```")) {
 			root.appendNode(Node::Type::Tag, Strings::CodeStart);
 
-			QString language = s.right(s.length() - 3);
-			QStringList codeLines;
+			const QByteArray language = s.right(s.length() - 3);
+			QList <QByteArray> codeLines;
 
 			bool end = false;
 			do {
 				if (line == lines.count()) {
-					qCritical() << "Unexpected EOF";
-					abort();
+					Diagnostics::error("Unexpected EOF");
+					return {};
 				}
 				s = lines[line++];
 				end = s.startsWith("```");
@@ -121,27 +144,25 @@ std::optional <Document> MarkdownParser::doParse(const QString &data)
 					codeLines.append(s);
 			} while (!end);
 
-			if (language.isEmpty()) {
-				for (QString &l : codeLines) {
-					Node &codeLine = root.appendNode(Node::Type::Environment, Strings::CodeLine);
-					Node &lineContent = codeLine.appendNode(Node::Type::Fragment, Strings::TextTT); //temporary hack until syntax coloring for markdown is added
-					addEntities(l);
-					lineContent.appendNode(Node::Type::Text, l);
-				}
+			if (language.isEmpty() || draft()) {
+				addPlainCode(root, codeLines);
 			} else {
+				Metrics::PhaseTimer timer{Metrics::Phase::Highlight};
 				QProcess highlight;
-				highlight.start("highlight", QString{"-O latex --replace-quotes -j 3 -z -V -f -t 4 --encoding=utf-8 --syntax=%1"}.arg(language).split(' '));
-				for (const QString &l : codeLines) {
-					highlight.write(l.toUtf8());
+				highlight.start("highlight", QString{"-O latex --replace-quotes -j 3 -z -V -f -t 4 --encoding=utf-8 --syntax=%1"}.arg(QString::fromUtf8(language)).split(' '));
+				for (const QByteArray &l : codeLines) {
+					highlight.write(l);
 					highlight.write("\n");
 				}
 				highlight.closeWriteChannel();
 				highlight.waitForFinished();
-				QByteArray output = highlight.readAllStandardOutput();
+				const QByteArray output = highlight.readAllStandardOutput();
 				parseCtx.inCode = true;
 				int idx = 0;
-				parseSource(QString{output}, idx, root, QString{});
+				const bool result = parseSource(output, idx, root, '\0');
 				parseCtx.inCode = false;
+				if (!result)
+					return {};
 			}
 			root.appendNode(Node::Type::Tag, Strings::CodeEnd);
 			continue;
@@ -162,8 +183,10 @@ std::optional <Document> MarkdownParser::doParse(const QString &data)
 
 		Node &n = root.appendNode(Node::Type::Environment, envName);
 		int idx = hashSymbolCnt;
-		parseSource(s, idx, n, QString{});
+		if (!parseSource(s, idx, n, '\0'))
+			return {};
 	}
 
+	endStream(root);
 	return std::move(doc);
 }
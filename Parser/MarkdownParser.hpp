@@ -4,11 +4,11 @@
 
 class MarkdownParser : public Parser {
 private:
-	std::optional <Document> doParse(const QString &data) override;
+	std::optional <Document> doParse(const QByteArray &data) override;
 
 	struct {
-		bool inCode;
+		bool inCode = false;
 	} parseCtx;
 
-	void parseSource(const QString &data, int &idx, Node &node, const QString &endMarker);
+	bool parseSource(const QByteArray &data, int &idx, Node &node, char endMarker);
 };
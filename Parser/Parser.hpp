@@ -1,23 +1,127 @@
 #pragma once
 
+#include "AllocStats.hpp"
+#include "Diagnostics.hpp"
 #include "Document.hpp"
+#include "EventQueue.hpp"
+#include "Metrics.hpp"
 
+/*
+ * Parsers work on the UTF-8 input as it is; node values are UTF-8 as well.
+ */
 class Parser {
 
 public:
-	std::optional <Document> parse(const QString &data) { return doParse(data); }
+	/*
+	 * With a `stream`, the title and the finished parts of the document
+	 * body are pushed to it while parsing goes on, and the returned
+	 * document's body is empty. The End event is left to the caller.
+	 */
+	std::optional <Document> parse(const QByteArray &data, EventQueue *stream = nullptr)
+	{
+		ALLOC_PHASE("parse");
+		Metrics::PhaseTimer timer{Metrics::Phase::Parse};
+		m_stream = stream;
+		m_streamRoot = nullptr;
+		m_entered = false;
+		return doParse(data);
+	}
+
+	/* Trade fidelity for speed: no highlighting, no typographic substitutions */
+	void setDraft(bool draft)
+	{
+		m_draft = draft;
+	}
+
+	/* Relative file names in the document are taken relative to `dir`; empty for the working directory */
+	void setBaseDir(const QString &dir)
+	{
+		m_baseDir = dir;
+	}
 
 protected:
-	void ensureData(const QString &data, int idx, int needBytes) const
+	bool draft() const
+	{
+		return m_draft;
+	}
+
+	const QString & baseDir() const
+	{
+		return m_baseDir;
+	}
+
+	/* The file a name in the document refers to */
+	QString path(const QByteArray &name) const
+	{
+		const QString filename = QString::fromUtf8(name);
+		return m_baseDir.isEmpty() ? filename : QDir{m_baseDir}.filePath(filename);
+	}
+
+	/*
+	 * Code lines as they are, in monospace and without highlighting. Tabs
+	 * are expanded as `highlight -t 4` would.
+	 */
+	void addPlainCode(Node &node, QList <QByteArray> lines) const
+	{
+		node.children.reserveMore(lines.count());
+		for (QByteArray &l : lines) {
+			Node &codeLine = node.appendNode(Node::Type::Environment, Strings::CodeLine);
+			Node &lineContent = codeLine.appendNode(Node::Type::Fragment, Strings::TextTT);
+			addEntities(l);
+			lineContent.appendNode(Node::Type::Text, l.replace('\t', "    "));
+		}
+	}
+
+	void streamTitle(const Node &title)
+	{
+		if (m_stream != nullptr)
+			m_stream->push(Event{Event::Kind::Title, title.clone()});
+	}
+
+	/* `root` is the node whose children are streamed */
+	void beginStream(const Node &root)
+	{
+		m_streamRoot = &root;
+	}
+
+	/*
+	 * Hands the children of the streamed root over. Called whenever the
+	 * parser is back at the root's level, so all of them are finished.
+	 */
+	void flush(Node &root)
+	{
+		if (m_stream == nullptr || &root != m_streamRoot)
+			return;
+
+		if (!m_entered && root.type == Node::Type::Environment)
+			m_stream->push(Event{Event::Kind::Enter, Node{root.type, QByteArray{root.value}}});
+		m_entered = true;
+
+		for (Node &child : root.children)
+			m_stream->push(Event{Event::Kind::Subtree, std::move(child)});
+		root.children.clear();
+	}
+
+	void endStream(Node &root)
+	{
+		flush(root);
+		if (m_stream != nullptr && root.type == Node::Type::Environment)
+			m_stream->push(Event{Event::Kind::Exit, Node{}});
+		m_streamRoot = nullptr;
+	}
+
+
+	bool ensureData(const QByteArray &data, int idx, int needBytes) const
 	{
 		if (idx + needBytes >= data.size()) {
-			qCritical() << QString{"End of data, data.length() = %1, idx = %2, needBytes = %3"}.arg(data.length()).arg(idx).arg(needBytes);
-			std::exit(1);
+			Diagnostics::error(QString{"End of data, data.length() = %1, idx = %2, needBytes = %3"}.arg(data.length()).arg(idx).arg(needBytes));
+			return false;
 		}
+		return true;
 	}
 
 	//FIXME this shouldn't be in the Parser and better be a one-pass transform
-	void addEntities(QString &text) const
+	void addEntities(QByteArray &text) const
 	{
 		text.replace("&", "&amp;");
 		text.replace("<", "&lt;");
@@ -25,5 +129,11 @@ protected:
 	}
 
 private:
-	virtual std::optional <Document> doParse(const QString &data) = 0;
+	EventQueue *m_stream = nullptr;
+	const Node *m_streamRoot = nullptr;
+	bool m_entered = false;
+	bool m_draft = false;
+	QString m_baseDir;
+
+	virtual std::optional <Document> doParse(const QByteArray &data) = 0;
 };
@@ -0,0 +1,60 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "Fold.hpp"
+#include "Parser/StructuralIndex.hpp"
+
+bool StructuralIndex::isStructural(char c)
+{
+	return any_of(c, '\\', '{', '}', '$');
+}
+
+void StructuralIndex::build(const QByteArray &data)
+{
+	const char *bytes = data.constData();
+	m_size = data.size();
+	m_bits.fill(0, (m_size + 63) / 64);
+
+	int idx = 0;
+#ifdef __SSE2__
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i openBrace = _mm_set1_epi8('{');
+	const __m128i closeBrace = _mm_set1_epi8('}');
+	const __m128i dollar = _mm_set1_epi8('$');
+
+	for (; idx + 64 <= m_size; idx += 64) {
+		quint64 word = 0;
+		for (int part = 0; part < 4; ++part) {
+			const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + idx + 16 * part));
+			__m128i hits = _mm_cmpeq_epi8(chunk, backslash);
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, openBrace));
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, closeBrace));
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, dollar));
+			word |= quint64{static_cast<quint16>(_mm_movemask_epi8(hits))} << (16 * part);
+		}
+		m_bits[idx / 64] = word;
+	}
+#endif
+
+	for (; idx < m_size; ++idx) {
+		if (isStructural(bytes[idx]))
+			m_bits[idx / 64] |= quint64{1} << (idx % 64);
+	}
+}
+
+int StructuralIndex::next(int from) const
+{
+	if (from >= m_size)
+		return m_size;
+
+	int word = from / 64;
+	quint64 bits = m_bits[word] & (~quint64{0} << (from % 64));
+	while (bits == 0) {
+		if (++word == m_bits.count())
+			return m_size;
+		bits = m_bits[word];
+	}
+
+	return word * 64 + qCountTrailingZeroBits(bits);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <QtCore>
+
+/*
+ * Bitmap of the bytes the LaTeX parser has to look at one by one (\ { } $): one bit
+ * per input byte, built 64 bytes at a time with SSE2 where available. The
+ * plain text between two structural bytes can then be copied in one go.
+ */
+class StructuralIndex {
+public:
+	void build(const QByteArray &data);
+
+	// position of the first structural byte at or after `from`, size of the data if there is none
+	int next(int from) const;
+
+	static bool isStructural(char c);
+
+private:
+	QVector <quint64> m_bits;
+	int m_size = 0;
+};
@@ -0,0 +1,297 @@
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Output/Sink.hpp"
+#include "Queue.hpp"
+#include "Stats.hpp"
+
+namespace {
+
+const QString Incoming = "incoming";
+const QString Pending = "pending";
+const QString Claimed = "claimed";
+const QString Done = "done";
+const QString Failed = "failed";
+
+/*
+ * QFile::rename() neither replaces an existing target nor is it atomic
+ * once it falls back to copying, so the queue uses rename(2) directly.
+ */
+bool moveFile(const QString &from, const QString &to)
+{
+	return ::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) == 0;
+}
+
+bool touch(const QString &path)
+{
+	return ::utimensat(AT_FDCWD, QFile::encodeName(path).constData(), nullptr, 0) == 0;
+}
+
+/*
+ * Renews a claim from a thread of its own while the job is converted.
+ */
+class Lease {
+public:
+	Lease(const QString &claim, int seconds) :
+		m_thread{[this, claim, interval = std::chrono::milliseconds{seconds * 1000 / 4}](){
+			std::unique_lock <std::mutex> lock{m_mutex};
+			while (!m_condition.wait_for(lock, interval, [this](){ return m_stopped; }))
+				touch(claim);
+		}}
+	{
+	}
+
+	~Lease()
+	{
+		{
+			std::lock_guard <std::mutex> lock{m_mutex};
+			m_stopped = true;
+		}
+		m_condition.notify_one();
+		m_thread.join();
+	}
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopped = false;
+	std::thread m_thread;
+};
+
+}
+
+WorkQueue::WorkQueue(const QString &dir, int lease) :
+	m_dir{QFileInfo{dir}.absoluteFilePath()},
+	m_lease{qMax(lease, 1)},
+	m_owner{QString{"%1:%2"}.arg(QSysInfo::machineHostName()).arg(::getpid())}
+{
+}
+
+bool WorkQueue::init()
+{
+	for (const QString &subdir : {Incoming, Pending, Claimed, Done, Failed}) {
+		if (!m_dir.mkpath(subdir)) {
+			qCritical() << QString{"queue: unable to create %1"}.arg(m_dir.filePath(subdir));
+			return false;
+		}
+	}
+	return true;
+}
+
+bool WorkQueue::enqueue(const QString &source, const QString &output)
+{
+	if (!init())
+		return false;
+
+	const QFileInfo info{source};
+	if (!info.isFile()) {
+		qCritical() << QString{"queue: no such source: %1"}.arg(source);
+		return false;
+	}
+
+	const QString name = QString{"%1-%2-%3-%4"}.arg(info.size(), 16, 10, QChar{'0'}).arg(m_owner).arg(m_sequence++).arg(info.fileName());
+	const QString incoming = m_dir.filePath(Incoming + '/' + name);
+	QFile file{incoming};
+	const QByteArray job = QFile::encodeName(info.absoluteFilePath()) + '\n' + QFile::encodeName(QFileInfo{output}.absoluteFilePath()) + '\n';
+	if (!file.open(QIODevice::WriteOnly) || file.write(job) != job.size() || !file.flush()) {
+		qCritical() << QString{"queue: unable to write %1"}.arg(incoming);
+		return false;
+	}
+	file.close();
+
+	// written aside first, a worker never sees a partial job
+	if (!moveFile(incoming, m_dir.filePath(Pending + '/' + name))) {
+		qCritical() << QString{"queue: unable to enqueue %1"}.arg(source);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Workers only leave when nothing is claimed any more, since the job of
+ * a worker that dies still comes back to pending/.
+ */
+bool WorkQueue::work(Odtgen::InputFormat format, const Odtgen::Options &options)
+{
+	if (!init())
+		return false;
+
+	bool result = true;
+	for (;;) {
+		Stats::add("queue.jobs.recovered", recover());
+
+		std::optional <Job> job = claim();
+		if (!job) {
+			if (QDir{m_dir.filePath(Claimed)}.isEmpty())
+				break;
+			QThread::sleep(1);
+			continue;
+		}
+
+		QString error;
+		bool ok;
+		{
+			Lease lease{job->claim, m_lease};
+			ok = run(*job, format, options, error);
+		}
+		if (job->lost) {
+			qWarning() << QString{"queue: the claim of %1 was taken over by another worker, the job is left to it"}.arg(job->name);
+			Stats::add("queue.jobs.lost", 1);
+			continue;
+		}
+		finish(*job, ok, error);
+		result = result && ok;
+	}
+	return result;
+}
+
+bool WorkQueue::ownerDead(const QString &owner) const
+{
+	const int colon = owner.lastIndexOf(':');
+	if (colon == -1 || owner.left(colon) != QSysInfo::machineHostName())
+		return false; // only the lease tells about workers on other machines
+	return ::kill(owner.mid(colon + 1).toInt(), 0) == -1 && errno == ESRCH;
+}
+
+/*
+ * Claims are named <job>@<owner>. Their modification time is that of the
+ * last renewal, compared to the local clock: the machines sharing a queue
+ * are expected to keep their clocks well within a lease of each other.
+ */
+int WorkQueue::recover()
+{
+	int result = 0;
+	const QDateTime now = QDateTime::currentDateTimeUtc();
+	const QFileInfoList claims = QDir{m_dir.filePath(Claimed)}.entryInfoList(QDir::Files);
+	for (const QFileInfo &info : claims) {
+		const QString claim = info.fileName();
+		const int at = claim.lastIndexOf('@');
+		if (at == -1)
+			continue;
+
+		const QString owner = claim.mid(at + 1);
+		if (owner == m_owner)
+			continue;
+		const bool dead = ownerDead(owner);
+		if (!dead && info.lastModified().toUTC().secsTo(now) < m_lease)
+			continue;
+
+		QFile file{info.filePath()};
+		const QList <QByteArray> lines = file.open(QIODevice::ReadOnly) ? file.readAll().split('\n') : QList <QByteArray>{};
+		file.close();
+		if (!moveFile(info.filePath(), m_dir.filePath(Pending + '/' + claim.left(at))))
+			continue; // recovered by another worker already
+
+		// the partial output of a worker known to be gone; one that merely stalled may still be writing its own
+		if (dead && lines.count() > 1)
+			QFile::remove(QFile::decodeName(lines[1]) + ".part-" + owner);
+		++result;
+	}
+	return result;
+}
+
+std::optional <WorkQueue::Job> WorkQueue::claim()
+{
+	const QDir pending{m_dir.filePath(Pending)};
+	// names start with the zero-padded size, so in reverse order the largest job comes first
+	const QStringList names = pending.entryList(QDir::Files, QDir::Name | QDir::Reversed);
+	for (const QString &name : names) {
+		Job job;
+		job.name = name;
+		job.claim = m_dir.filePath(QString{"%1/%2@%3"}.arg(Claimed, name, m_owner));
+		if (!moveFile(pending.filePath(name), job.claim))
+			continue; // taken by another worker
+
+		// a rename keeps the modification time, the lease starts now
+		touch(job.claim);
+
+		QFile file{job.claim};
+		const QList <QByteArray> lines = file.open(QIODevice::ReadOnly) ? file.readAll().split('\n') : QList <QByteArray>{};
+		if (lines.count() < 2 || lines[0].isEmpty() || lines[1].isEmpty()) {
+			finish(job, false, "malformed job");
+			continue;
+		}
+		job.source = QFile::decodeName(lines[0]);
+		job.output = QFile::decodeName(lines[1]);
+		return job;
+	}
+	return {};
+}
+
+/*
+ * The output is written under a name of its own and renamed when it is
+ * complete, so readers of the output never see a partial document. Right
+ * before the rename the claim is renewed, which fails once another worker
+ * has taken it over: the job is then left to that worker. A takeover after
+ * that point only has the job converted twice, each output complete.
+ */
+bool WorkQueue::run(Job &job, Odtgen::InputFormat format, const Odtgen::Options &options, QString &error)
+{
+	QFile file{job.source};
+	if (!file.open(QIODevice::ReadOnly)) {
+		error = QString{"unable to open source: %1"}.arg(job.source);
+		return false;
+	}
+	const QByteArray data = file.readAll();
+
+	// \input and \sourcecodefile names are relative to the source
+	Odtgen::Options jobOptions = options;
+	jobOptions.baseDir = QFileInfo{job.source}.absolutePath();
+
+	const QString part = job.output + ".part-" + m_owner;
+	const int fd = ::open(QFile::encodeName(part).constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		error = QString{"unable to open output file: %1"}.arg(part);
+		return false;
+	}
+
+	bool result;
+	QStringList warnings;
+	{
+		FdSink out{fd};
+		result = Odtgen::convert(data, format, jobOptions, out, error, warnings);
+	}
+	for (const QString &warning : warnings)
+		qWarning().noquote() << QString{"%1: %2"}.arg(job.name, warning);
+	if (result && ::fsync(fd) == -1) {
+		error = QString{"unable to write output file: %1"}.arg(part);
+		result = false;
+	}
+	::close(fd);
+
+	if (result && !touch(job.claim)) {
+		job.lost = true;
+		QFile::remove(part);
+		return false;
+	}
+	if (result && !moveFile(part, job.output)) {
+		error = QString{"unable to rename %1 to %2"}.arg(part, job.output);
+		result = false;
+	}
+	if (!result)
+		QFile::remove(part);
+	return result;
+}
+
+void WorkQueue::finish(const Job &job, bool ok, const QString &error)
+{
+	if (!ok) {
+		qCritical().noquote() << QString{"%1: %2"}.arg(job.name, error);
+		QSaveFile log{m_dir.filePath(QString{"%1/%2.log"}.arg(Failed, job.name))};
+		if (log.open(QIODevice::WriteOnly)) {
+			log.write(error.toUtf8() + '\n');
+			log.commit();
+		}
+	}
+
+	if (!moveFile(job.claim, m_dir.filePath(QString{"%1/%2"}.arg(ok ? Done : Failed, job.name))))
+		qWarning() << QString{"queue: the claim of %1 was taken over by another worker"}.arg(job.name);
+	Stats::add(ok ? "queue.jobs.done" : "queue.jobs.failed", 1);
+}
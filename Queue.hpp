@@ -0,0 +1,52 @@
+#pragma once
+
+#include <optional>
+#include <QtCore>
+
+#include "Convert.hpp"
+
+/*
+ * A work queue shared by odtgen processes through a directory, on one
+ * machine or on several sharing the filesystem. A job is a file naming a
+ * source and its output, and moves on by rename(), which is atomic:
+ *
+ *   incoming/ -> pending/ -> claimed/ -> done/ or failed/
+ *
+ * hence every job is converted by one worker at a time. A worker renews
+ * its claim while converting; the claim of a worker that died, or stopped
+ * renewing it for the lease period, goes back to pending/. Job names start
+ * with the size of the source and the largest pending job is taken first,
+ * so large documents spread evenly across the workers.
+ */
+class WorkQueue {
+public:
+	static constexpr int DefaultLease = 60; // seconds
+
+	explicit WorkQueue(const QString &dir, int lease = DefaultLease);
+
+	bool enqueue(const QString &source, const QString &output);
+
+	/* Converts jobs until none is left pending or claimed; false if any failed. */
+	bool work(Odtgen::InputFormat format, const Odtgen::Options &options);
+
+private:
+	struct Job {
+		QString name;
+		QString claim; // path in claimed/
+		QString source;
+		QString output;
+		bool lost = false; // the claim was taken over while converting
+	};
+
+	bool init();
+	int recover();
+	std::optional <Job> claim();
+	bool run(Job &job, Odtgen::InputFormat format, const Odtgen::Options &options, QString &error);
+	void finish(const Job &job, bool ok, const QString &error);
+	bool ownerDead(const QString &owner) const;
+
+	QDir m_dir;
+	int m_lease;
+	QString m_owner; // host:pid
+	quint32 m_sequence = 0;
+};
@@ -0,0 +1,55 @@
+#include "Stats.hpp"
+
+namespace {
+
+thread_local Stats *currentStats = nullptr;
+
+}
+
+void Stats::add(const QString &name, qint64 value)
+{
+	Stats *stats = currentStats;
+	if (stats == nullptr)
+		return;
+
+	std::lock_guard <std::mutex> lock{stats->m_mutex};
+	stats->m_counters[name] += value;
+}
+
+void Stats::set(const QString &name, qint64 value)
+{
+	Stats *stats = currentStats;
+	if (stats == nullptr)
+		return;
+
+	std::lock_guard <std::mutex> lock{stats->m_mutex};
+	stats->m_counters[name] = value;
+}
+
+Stats * Stats::current()
+{
+	return currentStats;
+}
+
+void Stats::print() const
+{
+	std::lock_guard <std::mutex> lock{m_mutex};
+	QTextStream out{stderr};
+	out.setFieldAlignment(QTextStream::AlignLeft);
+	for (auto iter = m_counters.cbegin(); iter != m_counters.cend(); ++iter) {
+		out.setFieldWidth(48);
+		out << iter.key();
+		out.setFieldWidth(0);
+		out << iter.value() << '\n';
+	}
+}
+
+Stats::Scope::Scope(Stats *stats) : m_outer{currentStats}
+{
+	currentStats = stats;
+}
+
+Stats::Scope::~Scope()
+{
+	currentStats = m_outer;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <mutex>
+#include <QtCore>
+
+/*
+ * Named counters of a run, printed with --stats. Counting goes to the set
+ * in scope of the current thread; threads working on the same conversion
+ * share one set through Scope, and without a set in scope nothing is
+ * counted.
+ */
+class Stats {
+public:
+	/* Change a counter of the set in scope of the current thread, if any. */
+	static void add(const QString &name, qint64 value);
+	static void set(const QString &name, qint64 value);
+	static Stats * current();
+
+	void print() const;
+
+	class Scope {
+	public:
+		explicit Scope(Stats *stats);
+		~Scope();
+
+	private:
+		Stats *m_outer;
+	};
+
+private:
+	mutable std::mutex m_mutex;
+	QMap <QString, qint64> m_counters;
+};
@@ -1,43 +0,0 @@
-namespace Strings {
-
-const char *Backslash = "backslash";
-const char *Begin = "begin";
-const char *BoldFace = "textbf";
-const char *CodeEnd = "CodeEnd";
-const char *CodeLine = "CodeLine";
-const char *CodeStart = "CodeStart";
-const char *CodeTilde = "sim";
-const char *Document = "document";
-const char *End = "end";
-const char *Enumerate = "enumerate";
-const char *Hspace = "hspace";
-const char *Input = "input";
-const char *Italic = "textit";
-const char *Item = "item";
-const char *Itemize = "itemize";
-const char *Ldots = "ldots";
-const char *MakeTitle = "maketitle";
-const char *NormalFont = "normalfont";
-const char *Paragraph = "paragraph";
-const char *Quote = "dq";
-const char *Section = "section";
-const char *SourceCode = "sourcecodefile";
-const char *Subsection = "subsection";
-const char *Superscript = "superscript";
-const char *TextBackslash = "textbackslash";
-const char *Textbar = "textbar";
-const char *TextTT = "texttt";
-const char *TTFamily = "ttfamily";
-const char *Tilde = "textasciitilde";
-const char *Title = "title";
-const char *Underscore = "textunderscore";
-const char *Verbatim = "verbatim";
-
-} // Strings
-
-namespace Unicode {
-
-const char *NoSpaceDontBreak = u8"\u2060";
-const char *NonBreakingSpace = u8"\u00a0";
-
-} // Unicode
@@ -2,44 +2,48 @@
 
 namespace Strings {
 
-extern const char *Backslash;
-extern const char *Begin;
-extern const char *BoldFace;
-extern const char *CodeEnd;
-extern const char *CodeLine;
-extern const char *CodeStart;
-extern const char *CodeTilde;
-extern const char *Document;
-extern const char *End;
-extern const char *Enumerate;
-extern const char *Hspace;
-extern const char *Input;
-extern const char *Italic;
-extern const char *Item;
-extern const char *Itemize;
-extern const char *Ldots;
-extern const char *MakeTitle;
-extern const char *NormalFont;
-extern const char *Paragraph;
-extern const char *Quote;
-extern const char *Section;
-extern const char *SourceCode;
-extern const char *Subsection;
-extern const char *Superscript;
-extern const char *TextBackslash;
-extern const char *Textbar;
-extern const char *TextTT;
-extern const char *TTFamily;
-extern const char *Tilde;
-extern const char *Title;
-extern const char *Underscore;
-extern const char *Verbatim;
+constexpr const char *Backslash = "backslash";
+constexpr const char *Begin = "begin";
+constexpr const char *BoldFace = "textbf";
+constexpr const char *CodeEnd = "CodeEnd";
+constexpr const char *CodeLine = "CodeLine";
+constexpr const char *CodeStart = "CodeStart";
+constexpr const char *CodeTilde = "sim";
+constexpr const char *Document = "document";
+constexpr const char *End = "end";
+constexpr const char *Enumerate = "enumerate";
+constexpr const char *Hspace = "hspace";
+constexpr const char *Include = "include";
+constexpr const char *IncludeGraphics = "includegraphics";
+constexpr const char *Input = "input";
+constexpr const char *Italic = "textit";
+constexpr const char *Item = "item";
+constexpr const char *Itemize = "itemize";
+constexpr const char *Ldots = "ldots";
+constexpr const char *MakeTitle = "maketitle";
+constexpr const char *NewCommand = "newcommand";
+constexpr const char *NormalFont = "normalfont";
+constexpr const char *Paragraph = "paragraph";
+constexpr const char *Quote = "dq";
+constexpr const char *RenewCommand = "renewcommand";
+constexpr const char *Section = "section";
+constexpr const char *SourceCode = "sourcecodefile";
+constexpr const char *Subsection = "subsection";
+constexpr const char *Superscript = "superscript";
+constexpr const char *TextBackslash = "textbackslash";
+constexpr const char *Textbar = "textbar";
+constexpr const char *TextTT = "texttt";
+constexpr const char *TTFamily = "ttfamily";
+constexpr const char *Tilde = "textasciitilde";
+constexpr const char *Title = "title";
+constexpr const char *Underscore = "textunderscore";
+constexpr const char *Verbatim = "verbatim";
 
 } // Strings
 
 namespace Unicode {
 
-extern const char *NoSpaceDontBreak;
-extern const char *NonBreakingSpace;
+constexpr const char *NoSpaceDontBreak = u8"\u2060";
+constexpr const char *NonBreakingSpace = u8"\u00a0";
 
 } // Unicode
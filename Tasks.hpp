@@ -0,0 +1,31 @@
+#pragma once
+
+#include <future>
+#include <QtCore>
+
+/*
+ * A packaged task as a QRunnable, so that work on a QThreadPool can hand
+ * back its result (or exception) through a future.
+ */
+template <typename R>
+class Task : public QRunnable {
+public:
+	explicit Task(std::packaged_task <R ()> &&task) : m_task{std::move(task)} {}
+
+	void run() override
+	{
+		m_task();
+	}
+
+private:
+	std::packaged_task <R ()> m_task;
+};
+
+template <typename F>
+auto runTask(QThreadPool &pool, F &&function) -> std::future <decltype(function())>
+{
+	std::packaged_task <decltype(function()) ()> task{std::forward<F>(function)};
+	auto result = task.get_future();
+	pool.start(new Task <decltype(function())>{std::move(task)});
+	return result;
+}
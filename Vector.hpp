@@ -24,6 +24,24 @@ public:
 	int count() const noexcept { return m_data.size(); }
 	bool empty() const noexcept { return m_data.empty(); }
 
+	int capacity() const noexcept { return m_data.capacity(); }
+	void reserve(int size) { m_data.reserve(size); }
+	void shrink_to_fit() { m_data.shrink_to_fit(); }
+
+	/*
+	 * Pre-sizes for `extra` upcoming push_back()s; unlike a plain reserve()
+	 * this keeps the geometric growth, so repeated calls stay amortized O(1).
+	 */
+	void reserveMore(int extra)
+	{
+		const std::size_t needed = m_data.size() + extra;
+		if (needed > m_data.capacity())
+			m_data.reserve(std::max(needed, 2 * m_data.capacity()));
+	}
+
+	T & operator [] (int idx) noexcept { return m_data[idx]; }
+	const T & operator [] (int idx) const noexcept { return m_data[idx]; }
+
 	T & front() noexcept { return m_data.front(); }
 	const T & front() const noexcept { return m_data.front(); }
 
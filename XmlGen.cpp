@@ -1,11 +1,14 @@
 #include <QtCore>
 
+#include "Fold.hpp"
+#include "Formulas.hpp"
+#include "Images.hpp"
 #include "Markup/Highlight.hpp"
 #include "Strings.hpp"
 
-QString entryText(const QString &s)
+const char * entryText(const QByteArray &s)
 {
-	const QHash <QString, const char *> EntryText {
+	static const QHash <QByteArray, const char *> EntryText {
 		{Strings::BoldFace, "<text:span text:style-name=\"Bold\">"},
 		{Strings::CodeLine, "<text:p text:style-name=\"CodeLine\">"},
 		{Strings::Enumerate, "<text:list text:style-name=\"Enumerate\">"},
@@ -36,17 +39,17 @@ QString entryText(const QString &s)
 		{Highlight::Type, "<text:span text:style-name=\"HighlightType\">"},
 	};
 
-	return EntryText.value(s);
+	return EntryText.value(s, "");
 }
 
-QString exitText(const QString &s)
+const char * exitText(const QByteArray &s)
 {
 	static const char * HeaderEnd = "</text:h>";
 	static const char * ListEnd = "</text:list>";
 	static const char * ParagraphEnd = "</text:p>";
 	static const char * SpanEnd = "</text:span>";
 
-	const QHash <QString, const char *> ExitText {
+	static const QHash <QByteArray, const char *> ExitText {
 		{Strings::BoldFace, SpanEnd},
 		{Strings::CodeLine, ParagraphEnd},
 		{Strings::Italic, SpanEnd},
@@ -77,5 +80,60 @@ QString exitText(const QString &s)
 		{Highlight::Type, SpanEnd},
 	};
 
-	return ExitText.value(s);
+	return ExitText.value(s, "");
 };
+
+QByteArray imageFrame(const Image &image, const QByteArray &options)
+{
+	static const double MaxWidth = 16.0;
+	static const double DefaultDpi = 96.0;
+	static const QHash <QString, double> UnitToCm {
+		{"cm", 1.0},
+		{"mm", 0.1},
+		{"in", 2.54},
+		{"pt", 2.54 / 72.27},
+	};
+	static const QRegularExpression WidthOption{"(?:^|,)\\s*width\\s*=\\s*([0-9.]+)\\s*(cm|mm|in|pt)"};
+
+	double width = image.width * 2.54 / DefaultDpi;
+	const QRegularExpressionMatch match = WidthOption.match(QString::fromUtf8(options));
+	if (match.hasMatch())
+		width = match.captured(1).toDouble() * UnitToCm.value(match.captured(2));
+	width = std::min(width, MaxWidth);
+	const double height = (image.width > 0) ? width * image.height / image.width : 0.0;
+
+	return QString{"<draw:frame text:anchor-type=\"as-char\" svg:width=\"%1cm\" svg:height=\"%2cm\">"
+		"<draw:image xlink:href=\"%3\" xlink:type=\"simple\" xlink:show=\"embed\" xlink:actuate=\"onLoad\"/>"
+		"</draw:frame>"}.arg(width, 0, 'f', 3).arg(height, 0, 'f', 3).arg(image.href).toUtf8();
+}
+
+/*
+ * The office suite lays embedded formulas out again when loading, the frame
+ * size only has to be close: one slot per symbol, commands counting as one.
+ */
+QByteArray formulaFrame(const Formula &formula)
+{
+	static const double SymbolWidth = 0.22;
+	static const double LineHeight = 0.5;
+	static const double MaxWidth = 16.0;
+
+	int symbols = 0;
+	bool inCommand = false;
+	for (const char c : formula.tex) {
+		const bool isLetter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+		if (inCommand && isLetter)
+			continue;
+		inCommand = (c == '\\');
+		if (!any_of(c, '{', '}', '^', '_', ' ') && (static_cast<uchar>(c) & 0xc0) != 0x80)
+			++symbols;
+	}
+
+	const double width = std::min(std::max(symbols, 1) * SymbolWidth, MaxWidth);
+	double height = formula.display ? 2 * LineHeight : LineHeight;
+	if (formula.tex.contains("\\frac"))
+		height *= 1.6;
+
+	return QString{"<draw:frame text:anchor-type=\"as-char\" svg:width=\"%1cm\" svg:height=\"%2cm\">"
+		"<draw:object xlink:href=\"./%3\" xlink:type=\"simple\" xlink:show=\"embed\" xlink:actuate=\"onLoad\"/>"
+		"</draw:frame>"}.arg(width, 0, 'f', 3).arg(height, 0, 'f', 3).arg(formula.href).toUtf8();
+}
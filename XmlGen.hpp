@@ -2,5 +2,10 @@
 
 #include <QtCore>
 
-QString entryText(const QString &s);
-QString exitText(const QString &s);
+struct Formula;
+struct Image;
+
+const char * entryText(const QByteArray &s);
+const char * exitText(const QByteArray &s);
+QByteArray imageFrame(const Image &image, const QByteArray &options);
+QByteArray formulaFrame(const Formula &formula);
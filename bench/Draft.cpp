@@ -0,0 +1,107 @@
+#include <limits>
+
+#include "Convert.hpp"
+
+/*
+ * Time to a complete preview package with --draft, against the same
+ * conversion without it, on a generated LaTeX document of about 100 pages:
+ * sections, lists, emphasis and a few formulas per page. The first run of
+ * each mode is reported on its own, as an editor sees it on opening a file.
+ * Takes the template directory to package with; without one only the body
+ * is generated.
+ */
+namespace {
+
+constexpr int Pages = 100;
+constexpr int Rounds = 5;
+
+QByteArray generated()
+{
+	static const char * const Words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor"};
+
+	QByteArray result = "\\documentclass{article}\n\\title{Draft benchmark}\n\\begin{document}\n\\maketitle\n";
+	quint32 seed = 1;
+	auto words = [&seed, &result](int count){
+		for (int i = 0; i < count; ++i) {
+			seed = seed * 1103515245u + 12345u;
+			result += Words[(seed >> 16) % (sizeof(Words) / sizeof(Words[0]))];
+			result += (i % 13 == 12) ? " --- " : " ";
+		}
+	};
+
+	for (int page = 0; page < Pages; ++page) {
+		if (page % 5 == 0)
+			result += QByteArray{"\\section{Chapter "} + QByteArray::number(page / 5 + 1) + "}\n";
+		result += QByteArray{"\\subsection{Page "} + QByteArray::number(page + 1) + "}\n";
+		for (int paragraph = 0; paragraph < 5; ++paragraph) {
+			words(40);
+			result += "\\textbf{bold} and \\textit{italic} text with $x_{" + QByteArray::number(page) + "}^2 + y$ in it. ";
+			words(40);
+			result += "\n\n";
+		}
+		result += "\\begin{itemize}\n";
+		for (int item = 0; item < 3; ++item) {
+			result += "\\item ";
+			words(12);
+			result += '\n';
+		}
+		result += "\\end{itemize}\n";
+	}
+	result += "\\end{document}\n";
+	return result;
+}
+
+struct Run {
+	qint64 first;
+	qint64 best;
+	qint64 size;
+};
+
+Run measure(const QByteArray &input, const Odtgen::Options &options)
+{
+	Run result{0, std::numeric_limits<qint64>::max(), 0};
+	for (int round = 0; round < Rounds; ++round) {
+		QElapsedTimer timer;
+		timer.start();
+		const Odtgen::Result converted = Odtgen::convert(input, Odtgen::InputFormat::LaTeX, options);
+		const qint64 nsecs = timer.nsecsElapsed();
+		if (!converted.ok) {
+			qCritical().noquote() << converted.error;
+			return Run{-1, -1, -1};
+		}
+		if (round == 0)
+			result.first = nsecs;
+		result.best = std::min(result.best, nsecs);
+		result.size = converted.data.size();
+	}
+	return result;
+}
+
+void print(QTextStream &out, const QString &name, const Run &run)
+{
+	out << name << ": first " << QString::number(run.first / 1e6, 'f', 1) << " ms, best "
+		<< QString::number(run.best / 1e6, 'f', 1) << " ms, " << run.size << " bytes\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	Odtgen::Options options;
+	if (argc > 1) {
+		if (!options.tmpl.load(QString::fromLocal8Bit(argv[1])))
+			return 1;
+		options.output = Odtgen::OutputFormat::Odt;
+	}
+
+	const QByteArray input = generated();
+	QTextStream out{stdout};
+	out << "input: " << Pages << " pages, " << input.size() << " bytes, "
+		<< (options.output == Odtgen::OutputFormat::Odt ? "odt package" : "body only") << '\n';
+
+	options.draft = true;
+	print(out, "--draft", measure(input, options));
+	options.draft = false;
+	print(out, "full", measure(input, options));
+	return 0;
+}
@@ -0,0 +1,59 @@
+#include "Keywords.hpp"
+
+/*
+ * Times Keywords::find against the QHash it replaced on a token stream of
+ * the shape the parser produces: mostly known control words, with user
+ * macros and misspellings mixed in.
+ */
+namespace {
+
+constexpr int Rounds = 20000;
+
+const char * const Misses[] = {"lstinline", "emph", "cite", "label", "ref", "footnote", "myMacro", "textbff"};
+
+template <typename Lookup>
+qint64 measure(const QVector <QByteArray> &tokens, Lookup lookup, int &found)
+{
+	QElapsedTimer timer;
+	timer.start();
+	found = 0;
+	for (int round = 0; round < Rounds; ++round) {
+		for (const QByteArray &token : tokens)
+			found += lookup(token);
+	}
+	return timer.nsecsElapsed();
+}
+
+}
+
+int main()
+{
+	QHash <QByteArray, quint8> table;
+	QVector <QByteArray> tokens;
+	for (const Keywords::Keyword &keyword : Keywords::Table) {
+		table.insert(keyword.name, keyword.flags);
+		tokens.append(keyword.name);
+	}
+	for (const char *miss : Misses)
+		tokens.append(miss);
+
+	int foundPerfect, foundHash;
+	const qint64 perfect = measure(tokens, [](const QByteArray &token){
+		return Keywords::find(token).id != Keywords::NotFound;
+	}, foundPerfect);
+	const qint64 hash = measure(tokens, [&table](const QByteArray &token){
+		return table.constFind(token) != table.constEnd();
+	}, foundHash);
+
+	if (foundPerfect != foundHash) {
+		qCritical() << QString{"lookups disagree: %1 vs %2"}.arg(foundPerfect).arg(foundHash);
+		return 1;
+	}
+
+	const qint64 lookups = static_cast<qint64>(Rounds) * tokens.count();
+	QTextStream out{stdout};
+	out << "lookups: " << lookups << '\n';
+	out << "perfect hash: " << QString::number(static_cast<double>(perfect) / lookups, 'f', 2) << " ns/lookup\n";
+	out << "QHash: " << QString::number(static_cast<double>(hash) / lookups, 'f', 2) << " ns/lookup\n";
+	return 0;
+}
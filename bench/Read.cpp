@@ -0,0 +1,78 @@
+#include <fcntl.h>
+#include <limits>
+#include <unistd.h>
+
+#include "AsyncIO.hpp"
+
+/*
+ * Reads a set of files through readFiles() with io_uring and with the plain
+ * system calls, each time with the files evicted from the page cache first,
+ * as a prefetch of \input and \sourcecodefile files meets them after a
+ * checkout. Takes the files to read, by default 256 generated files of
+ * 64 KiB in a temporary directory.
+ */
+namespace {
+
+constexpr int Rounds = 5;
+
+void evict(const QStringList &paths)
+{
+	for (const QString &path : paths) {
+		const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+		if (fd == -1)
+			continue;
+		::fdatasync(fd);
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		::close(fd);
+	}
+}
+
+qint64 best(const QStringList &paths, bool ring, qint64 &bytes)
+{
+	IoUring::setEnabled(ring);
+	qint64 result = std::numeric_limits<qint64>::max();
+	for (int round = 0; round < Rounds; ++round) {
+		evict(paths);
+		QElapsedTimer timer;
+		timer.start();
+		ReadBatch batch = readFiles(paths);
+		bytes = 0;
+		for (auto &file : batch.files) {
+			const std::optional <QByteArray> data = file.get();
+			bytes += data ? data->size() : 0;
+		}
+		batch.done.wait();
+		result = std::min(result, timer.nsecsElapsed());
+	}
+	return result;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	QTemporaryDir dir;
+	QStringList paths;
+	for (int i = 1; i < argc; ++i)
+		paths.append(QString::fromLocal8Bit(argv[i]));
+	if (paths.isEmpty()) {
+		const QByteArray content(64 << 10, 'x');
+		for (int i = 0; i < 256; ++i) {
+			QFile file{dir.filePath(QString{"file%1.tex"}.arg(i))};
+			if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size()) {
+				qCritical() << QString{"unable to write %1"}.arg(file.fileName());
+				return 1;
+			}
+			paths.append(file.fileName());
+		}
+	}
+
+	QTextStream out{stdout};
+	qint64 bytes = 0;
+	const qint64 ring = best(paths, true, bytes);
+	const qint64 plain = best(paths, false, bytes);
+	out << "input: " << paths.count() << " files, " << bytes << " bytes, evicted from the page cache\n";
+	out << "io_uring: " << QString::number(ring / 1e6, 'f', 2) << " ms\n";
+	out << "plain: " << QString::number(plain / 1e6, 'f', 2) << " ms\n";
+	return 0;
+}
@@ -0,0 +1,115 @@
+#include <limits>
+#include <zlib.h>
+
+#include "Output/Zip.hpp"
+
+/*
+ * Compares the chunked, multi-threaded content.xml entry of ZipWriter
+ * with one plain deflate stream over the same bytes: time and compressed
+ * size. Takes a file to compress, by default a generated body of about
+ * 16 MiB made of typical paragraph markup.
+ */
+namespace {
+
+constexpr int Rounds = 3;
+
+QByteArray generated()
+{
+	static const char * const Words[] = {"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing", "elit", "sed", "do", "eiusmod", "tempor"};
+
+	QByteArray result;
+	quint32 seed = 1;
+	while (result.size() < (16 << 20)) {
+		result += "<text:p text:style-name=\"Paragraph\">";
+		for (int i = 0; i < 80; ++i) {
+			seed = seed * 1103515245u + 12345u;
+			result += Words[(seed >> 16) % (sizeof(Words) / sizeof(Words[0]))];
+			result += (i % 17 == 16) ? "<text:span text:style-name=\"Bold\">bold</text:span> " : " ";
+		}
+		result += "</text:p>";
+	}
+	return result;
+}
+
+struct Run {
+	qint64 nsecs;
+	qint64 size;
+};
+
+template <typename Compress>
+Run best(Compress compress)
+{
+	Run result{std::numeric_limits<qint64>::max(), 0};
+	for (int round = 0; round < Rounds; ++round) {
+		QElapsedTimer timer;
+		timer.start();
+		const qint64 size = compress();
+		result.nsecs = std::min(result.nsecs, timer.nsecsElapsed());
+		result.size = size;
+	}
+	return result;
+}
+
+Run plain(const QByteArray &input, int level)
+{
+	return best([&input, level](){
+		z_stream stream{};
+		deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+		QByteArray output(deflateBound(&stream, input.size()), Qt::Uninitialized);
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+		stream.avail_in = input.size();
+		stream.next_out = reinterpret_cast<Bytef *>(output.data());
+		stream.avail_out = output.size();
+		deflate(&stream, Z_FINISH);
+		const qint64 size = stream.total_out;
+		deflateEnd(&stream);
+		return size;
+	});
+}
+
+Run chunked(const QByteArray &input, int level, int threads)
+{
+	return best([&input, level, threads](){
+		BufferSink out;
+		ZipWriter zip{out, level, threads};
+		{
+			std::unique_ptr <Sink> entry = zip.openFile("content.xml");
+			for (int offset = 0; offset < input.size(); offset += 64 << 10)
+				entry->write(input.constData() + offset, std::min(64 << 10, input.size() - offset));
+			entry->finish();
+		}
+		zip.finish();
+		return static_cast<qint64>(out.data().size());
+	});
+}
+
+void print(QTextStream &out, const QString &name, const Run &run, qint64 inputSize)
+{
+	out << name << ": " << QString::number(inputSize / 1048576.0 / (run.nsecs / 1e9), 'f', 1) << " MiB/s, "
+		<< run.size << " bytes\n";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+	QByteArray input;
+	if (argc > 1) {
+		QFile file{QString::fromLocal8Bit(argv[1])};
+		if (!file.open(QIODevice::ReadOnly)) {
+			qCritical() << QString{"unable to open %1"}.arg(file.fileName());
+			return 1;
+		}
+		input = file.readAll();
+	} else {
+		input = generated();
+	}
+
+	const int level = Z_DEFAULT_COMPRESSION;
+	QTextStream out{stdout};
+	out << "input: " << input.size() << " bytes, " << QThread::idealThreadCount() << " CPUs\n";
+	print(out, "zlib, one stream", plain(input, level), input.size());
+	for (int threads = 1; threads <= std::max(4, QThread::idealThreadCount()); threads *= 2)
+		print(out, QString{"ZipWriter, %1 threads"}.arg(threads), chunked(input, level, threads), input.size());
+	return 0;
+}
@@ -0,0 +1,69 @@
+#!/bin/bash
+#
+# Runs a number of odtgen workers on one work queue in a temporary
+# directory and checks the outcome against conversions without the queue:
+# every job done, no output missing, partial or different. The documents
+# differ widely in size and \input a file next to them, in two directories
+# with different contents. One worker is killed while the others run, so
+# its claim has to be recovered. Needs unzip.
+#
+# usage: bench/queue.sh <template dir> [workers] [jobs]
+
+set -e
+shopt -s nullglob
+
+ODTGEN="$(realpath "${ODTGEN:-./odtgen}")"
+tmpl="$(realpath "${1:?usage: $0 <template dir> [workers] [jobs]}")"
+workers=${2:-4}
+jobs=${3:-40}
+
+dir="$(mktemp -d)"
+trap 'rm -rf "${dir}"' EXIT
+
+for i in $(seq 1 ${jobs}); do
+	src="${dir}/src$(( i % 2 ))"
+	mkdir -p "${src}"
+	[ -f "${src}/common.tex" ] || printf 'Shared by everything in %s.\n\n' "$(basename "${src}")" > "${src}/common.tex"
+	{
+		printf '\\documentclass{article}\n\\title{Job %d}\n\\begin{document}\n\\maketitle\n\\input{common}\n' ${i}
+		for p in $(seq 1 $(( (i * 37) % 300 + 1 ))); do
+			printf '\\section{Part %d}\nSome \\textbf{bold} text and $x_{%d}^2$ in paragraph %d of job %d.\n\n' ${p} ${p} ${p} ${i}
+		done
+		printf '\\end{document}\n'
+	} > "${src}/job${i}.tex"
+done
+
+"${ODTGEN}" --template "${tmpl}" --queue "${dir}/queue" --enqueue "${dir}"/src*/job*.tex
+
+start=$(date +%s%N)
+pids=()
+for w in $(seq 1 ${workers}); do
+	"${ODTGEN}" --template "${tmpl}" --queue "${dir}/queue" --lease 2 --threads 1 --stats 2> "${dir}/worker${w}.log" &
+	pids+=($!)
+done
+sleep 0.2
+kill -KILL ${pids[0]} 2> /dev/null || true
+status=0
+for pid in "${pids[@]}"; do
+	wait ${pid} || [ ${pid} = ${pids[0]} ] || status=1
+done
+elapsed=$(( ($(date +%s%N) - start) / 1000000 ))
+
+failed=0
+for tex in "${dir}"/src*/job*.tex; do
+	(cd "$(dirname "${tex}")" && "${ODTGEN}" --template "${tmpl}" --threads 1 --output "${tex%.tex}.ref" < "${tex}")
+	# the entries carry the time they were written, so only their contents are compared
+	if ! cmp -s <(unzip -p "${tex%.tex}.odt") <(unzip -p "${tex%.tex}.ref"); then
+		echo "wrong or missing output: ${tex%.tex}.odt"
+		failed=$(( failed + 1 ))
+	fi
+done
+
+done=$(ls "${dir}/queue/done" | wc -l)
+left=$(find "${dir}/queue/pending" "${dir}/queue/claimed" "${dir}/queue/failed" -type f | wc -l)
+parts=$(find "${dir}" -name '*.part-*' | wc -l)
+recovered=$(cat "${dir}"/worker*.log | awk '$1 == "queue.jobs.recovered" { sum += $2 } END { print sum + 0 }')
+
+echo "${workers} workers, one killed, ${jobs} jobs in ${elapsed} ms: ${done} done, ${left} left or failed, ${recovered} recovered"
+echo "outputs differing from a plain conversion: ${failed}, partial outputs left: ${parts}"
+[ ${status} = 0 ] && [ ${failed} = 0 ] && [ ${done} = ${jobs} ] && [ ${left} = 0 ] && [ ${parts} = 0 ]
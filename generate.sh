@@ -15,7 +15,8 @@ for file in $@; do
 	if [ -d "${src_dir}" ] && [ -z "${src_dirs[${src_dir}]}" ]; then
 		echo "Syntax highlighting for directory: ${src_dir}"
 		src_dirs[${src_dir}]=1
-		find "${src_dir}" -name '*.cpp' -exec /bin/bash -c "${HIGHLIGHT}"' -i "${0}" > "${0}".tex' {} \;
+		# like make: a .tex newer than its source is kept
+		find "${src_dir}" -name '*.cpp' -exec /bin/bash -c '[ "${0}".tex -nt "${0}" ] || '"${HIGHLIGHT}"' -i "${0}" > "${0}".tex' {} \;
 	fi
 
 	cp -r "${TOOL_ROOT}"/workspace .
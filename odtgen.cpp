@@ -1,25 +1,203 @@
-#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
 #include <QtCore>
 
-#include "Parser/LaTeXParser.hpp"
-#include "Parser/MarkdownParser.hpp"
-#include "Document.hpp"
+#include "AllocStats.hpp"
+#include "AsyncIO.hpp"
+#include "Convert.hpp"
+#include "Depends.hpp"
+#include "Metrics.hpp"
+#include "Output/Sink.hpp"
+#include "Queue.hpp"
+#include "Stats.hpp"
 
 int main(int argc, char *argv[])
 {
-	QTextStream input{stdin};
-	QString data = input.readAll();
+	QCommandLineParser cmdLine;
+	const QCommandLineOption MarkdownOption{"M", "Parse the input as Markdown."};
+	const QCommandLineOption MacrosOption{{"m", "macros"}, "Load \\newcommand definitions from <file>.", "file"};
+	const QCommandLineOption OutputOption{{"o", "output"}, "Write a complete .odt package (or flat XML with --flat) to <file> instead of the document body to stdout.", "file"};
+	const QCommandLineOption FlatOption{"flat", "Emit a single flat ODF (.fodt) document."};
+	const QCommandLineOption LevelOption{"level", "Deflate level (0-9, or -1 for the zlib default) of the package entries.", "level", QString::number(Z_DEFAULT_COMPRESSION)};
+	const QCommandLineOption ThreadsOption{"threads", "Number of threads compressing content.xml.", "count", QString::number(QThread::idealThreadCount())};
+	const QCommandLineOption TemplateOption{{"t", "template"}, "Directory with content.header.xml, content.footer.xml, styles.xml and meta.xml.", "dir"};
+	const QCommandLineOption StatsOption{"stats", "Print statistics of the run to stderr."};
+	const QCommandLineOption MaxTimeOption{"max-time", "Abort the conversion after <ms> milliseconds.", "ms"};
+	const QCommandLineOption MaxNodesOption{"max-nodes", "Abort the conversion once the document has more than <count> nodes.", "count"};
+	const QCommandLineOption MaxOutputOption{"max-output", "Abort the conversion once the document body exceeds <bytes>.", "bytes"};
+	const QCommandLineOption MaxDepthOption{"max-depth", "Abort the conversion once the parser nests deeper than <levels>.", "levels", QString::number(Limits{}.depth)};
+	const QCommandLineOption StreamOption{"stream", "Emit the document while it is being parsed instead of building it as a whole first."};
+	const QCommandLineOption DraftOption{"draft", "Fast preview: plain code, no typographic substitutions, uncompressed package."};
+	const QCommandLineOption SyncIoOption{"sync-io", "Use plain blocking reads and writes instead of io_uring."};
+	const QCommandLineOption DependsOption{"depends", "Record the files --output depends on in <file>, and skip the conversion while none of them changed.", "file"};
+	const QCommandLineOption QueueOption{"queue", "Convert the jobs of the work queue in <dir>, shared with other odtgen processes, until it is empty.", "dir"};
+	const QCommandLineOption EnqueueOption{"enqueue", "Add the given files to --queue, to be converted next to their source, instead of working on it."};
+	const QCommandLineOption LeaseOption{"lease", "Seconds without renewal after which the claim of a queue worker is taken over.", "seconds", QString::number(WorkQueue::DefaultLease)};
+	const QCommandLineOption MetricsSocketOption{"metrics-socket", "While working on --queue, serve live metrics in the Prometheus text format over HTTP on the Unix socket <path>.", "path"};
+	const QCommandLineOption SplitOption{"split", "Write every top-level section to an .odt of its own next to --output, and --output as an .odm master document linking them."};
+	cmdLine.addOptions({MarkdownOption, MacrosOption, OutputOption, FlatOption, LevelOption, ThreadsOption, TemplateOption, StatsOption,
+		MaxTimeOption, MaxNodesOption, MaxOutputOption, MaxDepthOption, StreamOption, DraftOption, SyncIoOption, DependsOption,
+		QueueOption, EnqueueOption, LeaseOption, MetricsSocketOption, SplitOption});
+	cmdLine.addPositionalArgument("files", "Sources to add with --enqueue.", "[files...]");
 
-	std::unique_ptr <Parser> parser;
+	QStringList args;
+	for (int i = 0; i < argc; ++i)
+		args.append(QString::fromLocal8Bit(argv[i]));
 
-	if (argc > 1 && strcmp(argv[1], "-M") == 0)
-		parser = std::make_unique<MarkdownParser>();
-	else
-		parser = std::make_unique<LaTeXParser>();
+	if (!cmdLine.parse(args)) {
+		qCritical() << cmdLine.errorText();
+		return 1;
+	}
 
-	auto doc = parser->parse(data);
-	if (doc)
-		doc->output();
+	IoUring::setEnabled(!cmdLine.isSet(SyncIoOption));
 
+	// counters of the process itself; each conversion gets the same set through Options
+	Stats stats;
+	Stats::Scope statsScope{&stats};
+	struct StatsPrinter {
+		~StatsPrinter()
+		{
+			if (!enabled)
+				return;
+			AllocStats::report();
+			stats.print();
+		}
+
+		const Stats &stats;
+		bool enabled;
+	} statsPrinter{stats, cmdLine.isSet(StatsOption)};
+
+	if (cmdLine.isSet(MetricsSocketOption) && (!cmdLine.isSet(QueueOption) || cmdLine.isSet(EnqueueOption))) {
+		qCritical() << "--metrics-socket requires --queue and no --enqueue";
+		return 1;
+	}
+
+	WorkQueue queue{cmdLine.value(QueueOption), cmdLine.value(LeaseOption).toInt()};
+	if (cmdLine.isSet(EnqueueOption)) {
+		if (!cmdLine.isSet(QueueOption)) {
+			qCritical() << "--enqueue requires --queue";
+			return 1;
+		}
+		const QString suffix = cmdLine.isSet(FlatOption) ? "fodt" : "odt";
+		for (const QString &source : cmdLine.positionalArguments()) {
+			const QFileInfo info{source};
+			if (!queue.enqueue(source, info.dir().filePath(info.completeBaseName() + '.' + suffix)))
+				return 1;
+		}
+		return 0;
+	}
+
+	QByteArray data;
+	if (!cmdLine.isSet(QueueOption)) {
+		QFile input;
+		input.open(stdin, QIODevice::ReadOnly);
+		data = input.readAll();
+	}
+
+	// checked before anything else is loaded, an unchanged document costs only the hashing
+	Depends depends;
+	QByteArray dependsKey;
+	const QString manifest = cmdLine.value(DependsOption);
+	if (cmdLine.isSet(DependsOption)) {
+		if (!cmdLine.isSet(OutputOption)) {
+			qCritical() << "--depends requires --output";
+			return 1;
+		}
+		dependsKey = Depends::key(data, args);
+		if (QFileInfo::exists(cmdLine.value(OutputOption)) && Depends::upToDate(manifest, dependsKey)) {
+			Stats::set("depends.skipped", 1);
+			return 0;
+		}
+		// the output is about to be truncated, a stale manifest must not vouch for it
+		QFile::remove(manifest);
+		if (!depends.addFile(QFileInfo{"/proc/self/exe"}.canonicalFilePath()))
+			return 1;
+	}
+
+	Odtgen::Options options;
+	if (cmdLine.isSet(OutputOption) || cmdLine.isSet(FlatOption) || cmdLine.isSet(QueueOption)) {
+		if (!cmdLine.isSet(TemplateOption)) {
+			qCritical() << "--output, --flat and --queue require --template";
+			return 1;
+		}
+		if (!options.tmpl.load(cmdLine.value(TemplateOption)))
+			return 1;
+	}
+
+	if (cmdLine.isSet(SplitOption)) {
+		if (!cmdLine.isSet(OutputOption) || cmdLine.isSet(FlatOption) || cmdLine.isSet(QueueOption)) {
+			qCritical() << "--split requires --output and no --flat or --queue";
+			return 1;
+		}
+		const QFileInfo info{cmdLine.value(OutputOption)};
+		options.output = Odtgen::OutputFormat::Master;
+		options.chapterBase = info.dir().filePath(info.completeBaseName());
+	} else if (cmdLine.isSet(FlatOption)) {
+		options.output = Odtgen::OutputFormat::Flat;
+	} else if (cmdLine.isSet(OutputOption) || cmdLine.isSet(QueueOption)) {
+		options.output = Odtgen::OutputFormat::Odt;
+	}
+	// queue jobs run in the directory of their source
+	for (const QString &file : cmdLine.values(MacrosOption))
+		options.macroFiles.append(QFileInfo{file}.absoluteFilePath());
+	bool levelOk, threadsOk, depthOk;
+	options.level = cmdLine.value(LevelOption).toInt(&levelOk);
+	options.threads = cmdLine.value(ThreadsOption).toInt(&threadsOk);
+	options.limits.depth = cmdLine.value(MaxDepthOption).toInt(&depthOk);
+	if (!levelOk || options.level < Z_DEFAULT_COMPRESSION || options.level > Z_BEST_COMPRESSION) {
+		qCritical() << "--level must be between -1 (the zlib default) and 9";
+		return 1;
+	}
+	if (!threadsOk || options.threads < 1) {
+		qCritical() << "--threads must be at least 1";
+		return 1;
+	}
+	if (!depthOk || options.limits.depth < 1) {
+		qCritical() << "--max-depth must be at least 1";
+		return 1;
+	}
+	options.limits.milliseconds = cmdLine.value(MaxTimeOption).toLongLong();
+	options.limits.nodes = cmdLine.value(MaxNodesOption).toLongLong();
+	options.limits.outputBytes = cmdLine.value(MaxOutputOption).toLongLong();
+	options.streaming = cmdLine.isSet(StreamOption);
+	options.draft = cmdLine.isSet(DraftOption);
+	if (cmdLine.isSet(DependsOption))
+		options.depends = &depends;
+	options.stats = &stats;
+
+	const Odtgen::InputFormat format = cmdLine.isSet(MarkdownOption) ? Odtgen::InputFormat::Markdown : Odtgen::InputFormat::LaTeX;
+	if (cmdLine.isSet(QueueOption)) {
+		QString error;
+		if (cmdLine.isSet(MetricsSocketOption) && !Metrics::serve(cmdLine.value(MetricsSocketOption), error)) {
+			qCritical().noquote() << error;
+			return 1;
+		}
+		return queue.work(format, options) ? 0 : 1;
+	}
+
+	int fd = STDOUT_FILENO;
+	if (cmdLine.isSet(OutputOption)) {
+		fd = ::open(QFile::encodeName(cmdLine.value(OutputOption)).constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1) {
+			qCritical() << QString{"unable to open output file: %1"}.arg(cmdLine.value(OutputOption));
+			return 1;
+		}
+	}
+
+	FdSink output{fd};
+	QString error;
+	QStringList warnings;
+	const bool result = Odtgen::convert(data, format, options, output, error, warnings);
+	if (fd != STDOUT_FILENO)
+		::close(fd);
+
+	for (const QString &warning : warnings)
+		qWarning().noquote() << warning;
+	if (!result) {
+		qCritical().noquote() << error;
+		return 1;
+	}
+	if (options.depends != nullptr && !depends.write(manifest, dependsKey))
+		return 1;
 	return 0;
 }